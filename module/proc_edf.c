@@ -0,0 +1,220 @@
+/* Earliest deadline first policy for periodic processes. A process registered
+ * with a reservation, "runtime", "deadline" and "period", is given up to its
+ * runtime of CPU time every period and the one with the earliest absolute
+ * deadline runs first. A process which used up its budget is throttled until
+ * its next period starts, as is one which blocked or left the CPU idle while
+ * running, its job being done. Throttled processes and the ones without a
+ * reservation only get the CPU time no reserved process asks for.
+ *
+ * A period ending while its process is still runnable short of the whole
+ * budget, or a budget used up after the deadline, counts as a deadline miss
+ * of the process. A job which finished early and blocked is no miss.
+ * proc_queue refuses reservations beyond dl_bound on each run queue, so that
+ * the reserved processes of a CPU can meet their deadlines up to the quantum
+ * granularity.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+
+#include "sched_plugin.h"
+
+MODULE_AUTHOR("National Cheng Kung University, Taiwan");
+MODULE_DESCRIPTION("Earliest deadline first scheduling policy");
+MODULE_LICENSE("GPL");
+
+/* Run queue of the deadline policy */
+struct edf_rq {
+    struct rb_root_cached ready;     /* Reserved processes by deadline */
+    struct rb_root_cached throttled; /* Throttled processes by next period */
+    struct list_head background;     /* Processes without a reservation */
+};
+
+static bool edf_deadline_less(struct rb_node *a, const struct rb_node *b)
+{
+    return rb_entry(a, struct sched_plugin_task, run_node)->deadline <
+           rb_entry(b, struct sched_plugin_task, run_node)->deadline;
+}
+
+static bool edf_release_less(struct rb_node *a, const struct rb_node *b)
+{
+    return rb_entry(a, struct sched_plugin_task, run_node)->dl_release <
+           rb_entry(b, struct sched_plugin_task, run_node)->dl_release;
+}
+
+static struct sched_plugin_task *edf_first(struct rb_root_cached *root)
+{
+    struct rb_node *leftmost = rb_first_cached(root);
+
+    return leftmost ? rb_entry(leftmost, struct sched_plugin_task, run_node)
+                    : NULL;
+}
+
+/* Start the next period of a process, at the end of the current one or now
+ * if the process fell behind by more than its deadline. Budget left over by
+ * a runnable process is a job unfinished past its deadline.
+ */
+static void edf_replenish(struct sched_plugin_task *t, u64 now)
+{
+    u64 start = t->dl_release;
+
+    if (t->deadline && t->budget > 0 && !t->sleeping)
+        t->nr_missed++;
+    if (!t->deadline || start + t->dl_deadline <= now)
+        start = now;
+    t->deadline = start + t->dl_deadline;
+    t->dl_release = start + t->dl_period;
+    t->budget = t->dl_runtime;
+    t->dl_throttled = false;
+    t->nr_jobs++;
+}
+
+/* a process without a period yet or past its current one starts a new one */
+static void edf_update(struct sched_plugin_task *t, u64 now)
+{
+    if (!t->deadline || now >= t->dl_release)
+        edf_replenish(t, now);
+}
+
+static void *edf_alloc_rq(int cpu)
+{
+    struct edf_rq *erq =
+        kmalloc_node(sizeof(*erq), GFP_KERNEL, cpu_to_node(cpu));
+
+    if (erq) {
+        erq->ready = RB_ROOT_CACHED;
+        erq->throttled = RB_ROOT_CACHED;
+        INIT_LIST_HEAD(&erq->background);
+    }
+    return erq;
+}
+
+static void edf_free_rq(void *rq)
+{
+    kfree(rq);
+}
+
+static void edf_enqueue(void *rq, struct sched_plugin_task *t)
+{
+    struct edf_rq *erq = rq;
+
+    if (!t->dl_period) {
+        list_add_tail(&t->run_list, &erq->background);
+        return;
+    }
+    edf_update(t, ktime_get_ns());
+    if (t->dl_throttled)
+        rb_add_cached(&t->run_node, &erq->throttled, edf_release_less);
+    else
+        rb_add_cached(&t->run_node, &erq->ready, edf_deadline_less);
+}
+
+static void edf_dequeue(void *rq, struct sched_plugin_task *t)
+{
+    struct edf_rq *erq = rq;
+
+    if (!t->dl_period) {
+        list_del_init(&t->run_list);
+        return;
+    }
+    rb_erase_cached(&t->run_node,
+                    t->dl_throttled ? &erq->throttled : &erq->ready);
+    RB_CLEAR_NODE(&t->run_node);
+}
+
+static struct sched_plugin_task *edf_pick_next(void *rq)
+{
+    struct edf_rq *erq = rq;
+    struct sched_plugin_task *t = edf_first(&erq->ready);
+
+    if (t)
+        return t;
+    if (!list_empty(&erq->background))
+        return list_first_entry(&erq->background, struct sched_plugin_task,
+                                run_list);
+    return edf_first(&erq->throttled);
+}
+
+/* move the throttled processes whose next period started back to the ready
+ * ones
+ */
+static void edf_release(struct edf_rq *erq, u64 now)
+{
+    struct sched_plugin_task *t;
+
+    while ((t = edf_first(&erq->throttled)) && t->dl_release <= now) {
+        rb_erase_cached(&t->run_node, &erq->throttled);
+        edf_replenish(t, now);
+        rb_add_cached(&t->run_node, &erq->ready, edf_deadline_less);
+    }
+}
+
+/* Charge the budget of the running process and preempt it once it is
+ * throttled or a process with an earlier deadline is ready
+ */
+static bool edf_tick(void *rq, struct sched_plugin_task *curr)
+{
+    struct edf_rq *erq = rq;
+    struct sched_plugin_task *first;
+    u64 now = ktime_get_ns();
+    u64 wall, busy;
+
+    edf_release(erq, now);
+    if (!curr->dl_period)
+        return true;
+
+    /* A reservation given while running starts its first period here */
+    if (curr->deadline && !curr->dl_throttled) {
+        curr->budget -= curr->delta_exec;
+        wall = now - curr->exec_start;
+        busy = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
+        if (curr->sleeping || busy * 2 < wall) {
+            /* Blocked or mostly idle on the CPU, the job of this period is
+             * done
+             */
+            curr->budget = 0;
+        } else if (curr->budget <= 0 && now > curr->deadline) {
+            curr->nr_missed++;
+        }
+        if (curr->budget <= 0)
+            curr->dl_throttled = true;
+    }
+    edf_update(curr, now);
+    if (curr->dl_throttled)
+        return true;
+
+    first = edf_first(&erq->ready);
+    return first && first->deadline < curr->deadline;
+}
+
+static struct sched_plugin_policy edf_policy = {
+    .name = "edf",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = edf_alloc_rq,
+    .free_rq = edf_free_rq,
+    .enqueue = edf_enqueue,
+    .dequeue = edf_dequeue,
+    .pick_next = edf_pick_next,
+    .tick = edf_tick,
+};
+
+static int __init edf_policy_module_init(void)
+{
+    printk(KERN_INFO "Deadline policy module is being loaded.\n");
+    return sched_plugin_register_policy(&edf_policy);
+}
+
+static void __exit edf_policy_module_cleanup(void)
+{
+    printk(KERN_INFO "Deadline policy module is being unloaded.\n");
+    sched_plugin_unregister_policy(&edf_policy);
+}
+
+module_init(edf_policy_module_init);
+module_exit(edf_policy_module_cleanup);
@@ -0,0 +1,129 @@
+/* Weighted fair share policy: every process accumulates virtual runtime, its
+ * run time scaled by the inverse of its weight, and the process which has
+ * the least of it runs next. The waiting processes of a run queue are kept in
+ * a red-black tree ordered by virtual runtime, so picking the next one is a
+ * look at the cached leftmost node.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+
+#include "sched_plugin.h"
+
+MODULE_AUTHOR("National Cheng Kung University, Taiwan");
+MODULE_DESCRIPTION("Weighted fair share scheduling policy");
+MODULE_LICENSE("GPL");
+
+/* Run queue of the fair policy */
+struct fair_rq {
+    struct rb_root_cached tasks; /* Waiting processes by virtual runtime */
+    u64 min_vruntime;            /* Monotonic floor of the virtual runtimes */
+};
+
+static bool fair_less(struct rb_node *a, const struct rb_node *b)
+{
+    return rb_entry(a, struct sched_plugin_task, run_node)->vruntime <
+           rb_entry(b, struct sched_plugin_task, run_node)->vruntime;
+}
+
+static struct sched_plugin_task *fair_first(struct fair_rq *frq)
+{
+    struct rb_node *leftmost = rb_first_cached(&frq->tasks);
+
+    return leftmost ? rb_entry(leftmost, struct sched_plugin_task, run_node)
+                    : NULL;
+}
+
+static void *fair_alloc_rq(int cpu)
+{
+    struct fair_rq *frq =
+        kmalloc_node(sizeof(*frq), GFP_KERNEL, cpu_to_node(cpu));
+
+    if (frq) {
+        frq->tasks = RB_ROOT_CACHED;
+        frq->min_vruntime = 0;
+    }
+    return frq;
+}
+
+static void fair_free_rq(void *rq)
+{
+    kfree(rq);
+}
+
+/* A process new to the run queue starts at its floor, so that neither a
+ * newcomer nor one coming back from another run queue or policy can claim
+ * the CPU for the time it was away.
+ */
+static void fair_enqueue(void *rq, struct sched_plugin_task *t)
+{
+    struct fair_rq *frq = rq;
+
+    t->vruntime = max(t->vruntime, frq->min_vruntime);
+    rb_add_cached(&t->run_node, &frq->tasks, fair_less);
+}
+
+static void fair_dequeue(void *rq, struct sched_plugin_task *t)
+{
+    struct fair_rq *frq = rq;
+
+    rb_erase_cached(&t->run_node, &frq->tasks);
+    RB_CLEAR_NODE(&t->run_node);
+}
+
+static struct sched_plugin_task *fair_pick_next(void *rq)
+{
+    return fair_first(rq);
+}
+
+/* Charge the running process for the CPU time it consumed since the last
+ * tick and preempt it once a waiting process has run less than it
+ */
+static bool fair_tick(void *rq, struct sched_plugin_task *curr)
+{
+    struct fair_rq *frq = rq;
+    struct sched_plugin_task *first;
+    u64 vruntime;
+
+    curr->vruntime += div_u64(curr->delta_exec * SCHED_PLUGIN_WEIGHT_DEFAULT,
+                              curr->weight);
+
+    first = fair_first(frq);
+    vruntime = curr->vruntime;
+    if (first && first->vruntime < vruntime)
+        vruntime = first->vruntime;
+    frq->min_vruntime = max(frq->min_vruntime, vruntime);
+
+    return first && first->vruntime < curr->vruntime;
+}
+
+static struct sched_plugin_policy fair_policy = {
+    .name = "fair",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = fair_alloc_rq,
+    .free_rq = fair_free_rq,
+    .enqueue = fair_enqueue,
+    .dequeue = fair_dequeue,
+    .pick_next = fair_pick_next,
+    .tick = fair_tick,
+};
+
+static int __init fair_policy_module_init(void)
+{
+    printk(KERN_INFO "Fair share policy module is being loaded.\n");
+    return sched_plugin_register_policy(&fair_policy);
+}
+
+static void __exit fair_policy_module_cleanup(void)
+{
+    printk(KERN_INFO "Fair share policy module is being unloaded.\n");
+    sched_plugin_unregister_policy(&fair_policy);
+}
+
+module_init(fair_policy_module_init);
+module_exit(fair_policy_module_cleanup);
@@ -0,0 +1,359 @@
+/* Lottery policy: every process holds tickets and each quantum a ticket is
+ * drawn at random, its holder runs next. Over many quanta every process gets
+ * a share of the CPU in proportion to its tickets. The tickets of the waiting
+ * processes of a run queue are kept in a Fenwick tree over a dense array of
+ * slots, so both a draw and a change of the queue take O(log n) instead of a
+ * prefix sum walk over every waiting process.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/topology.h>
+
+#include "sched_plugin.h"
+
+MODULE_AUTHOR("National Cheng Kung University, Taiwan");
+MODULE_DESCRIPTION("Lottery scheduling policy");
+MODULE_LICENSE("GPL");
+
+#define LOTTERY_INIT_SLOTS 64 /* Slots of a new run queue, doubled as needed */
+
+/* Run queue of the lottery policy. Slot i, counted from 1, holds a waiting
+ * process and tree[i] the sum of the tickets of the slots i - lowbit(i) + 1
+ * to i. The waiting processes fill the slots 1 to nr without gaps.
+ */
+struct lottery_rq {
+    u64 *tree;                        /* Fenwick tree of the tickets */
+    struct sched_plugin_task **slots; /* Waiting processes by slot */
+    unsigned int nr;                  /* Slots in use */
+    unsigned int cap;                 /* Slots allocated, a power of two */
+    u64 total;                        /* Tickets of all slots */
+    struct list_head overflow;        /* Waiting processes without a slot */
+    struct sched_plugin_task *winner; /* Drawn and not run yet, or NULL */
+};
+
+static void fenwick_add(struct lottery_rq *lrq, unsigned int i, u64 delta)
+{
+    for (; i <= lrq->cap; i += i & -i)
+        lrq->tree[i] += delta;
+}
+
+/* slot holding ticket r, counting the tickets of the slots from 0 */
+static unsigned int fenwick_find(struct lottery_rq *lrq, u64 r)
+{
+    unsigned int pos = 0, step;
+
+    for (step = lrq->cap; step; step >>= 1) {
+        if (pos + step <= lrq->cap && lrq->tree[pos + step] <= r) {
+            pos += step;
+            r -= lrq->tree[pos];
+        }
+    }
+    return pos + 1;
+}
+
+/* Double the slots of a run queue. The callbacks run under the run queue
+ * lock, so this must not sleep; should it fail, the process waits in the
+ * overflow list instead.
+ */
+static bool lottery_grow(struct lottery_rq *lrq)
+{
+    unsigned int i, j, cap = lrq->cap * 2;
+    struct sched_plugin_task **slots;
+    u64 *tree;
+
+    tree = kcalloc(cap + 1, sizeof(*tree), GFP_ATOMIC | __GFP_NOWARN);
+    slots = kcalloc(cap + 1, sizeof(*slots), GFP_ATOMIC | __GFP_NOWARN);
+    if (!tree || !slots) {
+        kfree(tree);
+        kfree(slots);
+        return false;
+    }
+
+    /* Rebuild the tree in linear time, every node adding itself to its
+     * parent
+     */
+    memcpy(slots, lrq->slots, (lrq->nr + 1) * sizeof(*slots));
+    for (i = 1; i <= lrq->nr; i++)
+        tree[i] += slots[i]->tickets;
+    for (i = 1; i <= cap; i++) {
+        j = i + (i & -i);
+        if (j <= cap)
+            tree[j] += tree[i];
+    }
+
+    kfree(lrq->tree);
+    kfree(lrq->slots);
+    lrq->tree = tree;
+    lrq->slots = slots;
+    lrq->cap = cap;
+    return true;
+}
+
+static void lottery_free_rq(void *rq)
+{
+    struct lottery_rq *lrq = rq;
+
+    if (lrq) {
+        kfree(lrq->tree);
+        kfree(lrq->slots);
+    }
+    kfree(lrq);
+}
+
+static void *lottery_alloc_rq(int cpu)
+{
+    struct lottery_rq *lrq =
+        kzalloc_node(sizeof(*lrq), GFP_KERNEL, cpu_to_node(cpu));
+
+    if (!lrq)
+        return NULL;
+    lrq->cap = LOTTERY_INIT_SLOTS;
+    lrq->tree = kcalloc_node(lrq->cap + 1, sizeof(*lrq->tree), GFP_KERNEL,
+                             cpu_to_node(cpu));
+    lrq->slots = kcalloc_node(lrq->cap + 1, sizeof(*lrq->slots), GFP_KERNEL,
+                              cpu_to_node(cpu));
+    if (!lrq->tree || !lrq->slots) {
+        lottery_free_rq(lrq);
+        return NULL;
+    }
+    INIT_LIST_HEAD(&lrq->overflow);
+    return lrq;
+}
+
+/* put a process into the next free slot */
+static void lottery_add_slot(struct lottery_rq *lrq,
+                             struct sched_plugin_task *t)
+{
+    t->lottery_slot = ++lrq->nr;
+    lrq->slots[t->lottery_slot] = t;
+    fenwick_add(lrq, t->lottery_slot, t->tickets);
+    lrq->total += t->tickets;
+}
+
+static void lottery_enqueue(void *rq, struct sched_plugin_task *t)
+{
+    struct lottery_rq *lrq = rq;
+
+    lrq->winner = NULL;
+    if (lrq->nr == lrq->cap && !lottery_grow(lrq)) {
+        t->lottery_slot = 0;
+        list_add_tail(&t->run_list, &lrq->overflow);
+        return;
+    }
+    lottery_add_slot(lrq, t);
+}
+
+/* Free the slot of a process by moving the last slot into it, a process
+ * from the overflow list takes the last slot then
+ */
+static void lottery_dequeue(void *rq, struct sched_plugin_task *t)
+{
+    struct lottery_rq *lrq = rq;
+    unsigned int i = t->lottery_slot;
+    struct sched_plugin_task *last;
+
+    lrq->winner = NULL;
+    if (!i) {
+        list_del_init(&t->run_list);
+        return;
+    }
+
+    fenwick_add(lrq, i, -(u64) t->tickets);
+    lrq->total -= t->tickets;
+    t->lottery_slot = 0;
+    if (i != lrq->nr) {
+        last = lrq->slots[lrq->nr];
+        fenwick_add(lrq, lrq->nr, -(u64) last->tickets);
+        fenwick_add(lrq, i, last->tickets);
+        last->lottery_slot = i;
+        lrq->slots[i] = last;
+    }
+    lrq->slots[lrq->nr--] = NULL;
+
+    if (!list_empty(&lrq->overflow)) {
+        last = list_first_entry(&lrq->overflow, struct sched_plugin_task,
+                                run_list);
+        list_del_init(&last->run_list);
+        lottery_add_slot(lrq, last);
+    }
+}
+
+/* The draw is kept until the queue changes, so that the process returned is
+ * the one dequeued next
+ */
+static struct sched_plugin_task *lottery_pick_next(void *rq)
+{
+    struct lottery_rq *lrq = rq;
+    u64 r;
+
+    if (lrq->winner)
+        return lrq->winner;
+    if (lrq->total) {
+        div64_u64_rem(get_random_u64(), lrq->total, &r);
+        lrq->winner = lrq->slots[fenwick_find(lrq, r)];
+    } else if (!list_empty(&lrq->overflow)) {
+        lrq->winner = list_first_entry(&lrq->overflow,
+                                       struct sched_plugin_task, run_list);
+    }
+    return lrq->winner;
+}
+
+/* every quantum is a new lottery, the running process takes part again */
+static bool lottery_tick(void *rq, struct sched_plugin_task *curr)
+{
+    return true;
+}
+
+static struct sched_plugin_policy lottery_policy = {
+    .name = "lottery",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = lottery_alloc_rq,
+    .free_rq = lottery_free_rq,
+    .enqueue = lottery_enqueue,
+    .dequeue = lottery_dequeue,
+    .pick_next = lottery_pick_next,
+    .tick = lottery_tick,
+};
+
+#ifdef SCHED_PLUGIN_BENCH
+/* Fairness convergence benchmark, built with "make BENCH=1" and run with
+ * "insmod proc_lottery.ko bench=1". Synthetic processes with 1 to 100
+ * tickets are drawn from a private run queue the way rotate_process_queue
+ * does, and the mean deviation of their share of wins from their share of
+ * tickets is reported as the draws go on. The cost of a draw is compared
+ * with a prefix sum walk over the slots.
+ */
+#define BENCH_DRAWS 1000000
+#define BENCH_TIMED_DRAWS 10000
+
+static bool bench;
+module_param(bench, bool, 0);
+
+/* draw by walking the slots, the cost the Fenwick tree saves */
+static struct sched_plugin_task *bench_linear_draw(struct lottery_rq *lrq)
+{
+    unsigned int i;
+    u64 r;
+
+    div64_u64_rem(get_random_u64(), lrq->total, &r);
+    for (i = 1; i < lrq->nr; i++) {
+        if (r < lrq->slots[i]->tickets)
+            break;
+        r -= lrq->slots[i]->tickets;
+    }
+    return lrq->slots[i];
+}
+
+/* mean relative deviation of the shares of wins, in parts per million */
+static u64 bench_deviation(struct sched_plugin_task *tasks,
+                           unsigned int *wins,
+                           int n,
+                           u64 total,
+                           u64 draws)
+{
+    u64 sum = 0, got, want;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        got = wins[i] * total;
+        want = draws * tasks[i].tickets;
+        sum += div64_u64((got > want ? got - want : want - got) * 1000000,
+                         want);
+    }
+    return div_u64(sum, n);
+}
+
+static void bench_lottery_size(int n)
+{
+    struct sched_plugin_task *tasks, *t;
+    struct lottery_rq *lrq;
+    unsigned int *wins;
+    u64 t0, t_tree, t_linear, total = 0;
+    int i, draws;
+
+    tasks = kvcalloc(n, sizeof(*tasks), GFP_KERNEL);
+    wins = kvcalloc(n, sizeof(*wins), GFP_KERNEL);
+    lrq = lottery_alloc_rq(numa_node_id());
+    if (!tasks || !wins || !lrq)
+        goto out;
+
+    for (i = 0; i < n; i++) {
+        INIT_LIST_HEAD(&tasks[i].run_list);
+        tasks[i].tickets = 1 + i % 100;
+        total += tasks[i].tickets;
+        lottery_enqueue(lrq, &tasks[i]);
+    }
+
+    for (draws = 1; draws <= BENCH_DRAWS; draws++) {
+        t = lottery_pick_next(lrq);
+        lottery_dequeue(lrq, t);
+        wins[t - tasks]++;
+        lottery_enqueue(lrq, t);
+        if (draws % 1000 == 0)
+            cond_resched();
+        if (draws == 10 * n || draws == 100 * n || draws == BENCH_DRAWS)
+            printk(KERN_INFO
+                   "bench: lottery n=%d draws=%d deviation=%llu ppm\n", n,
+                   draws, bench_deviation(tasks, wins, n, total, draws));
+    }
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < BENCH_TIMED_DRAWS; i++) {
+        t = lottery_pick_next(lrq);
+        lottery_dequeue(lrq, t);
+        lottery_enqueue(lrq, t);
+    }
+    t_tree = ktime_get_ns() - t0;
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < BENCH_TIMED_DRAWS; i++)
+        bench_linear_draw(lrq);
+    t_linear = ktime_get_ns() - t0;
+
+    printk(KERN_INFO "bench: lottery n=%d fenwick=%llu linear=%llu ns/draw\n",
+           n, div_u64(t_tree, BENCH_TIMED_DRAWS),
+           div_u64(t_linear, BENCH_TIMED_DRAWS));
+
+out:
+    lottery_free_rq(lrq);
+    kvfree(wins);
+    kvfree(tasks);
+}
+
+static void bench_lottery(void)
+{
+    static const int sizes[] = {1000, 10000};
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+        bench_lottery_size(sizes[i]);
+}
+#endif
+
+static int __init lottery_policy_module_init(void)
+{
+    printk(KERN_INFO "Lottery policy module is being loaded.\n");
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench)
+        bench_lottery();
+#endif
+    return sched_plugin_register_policy(&lottery_policy);
+}
+
+static void __exit lottery_policy_module_cleanup(void)
+{
+    printk(KERN_INFO "Lottery policy module is being unloaded.\n");
+    sched_plugin_unregister_policy(&lottery_policy);
+}
+
+module_init(lottery_policy_module_init);
+module_exit(lottery_policy_module_cleanup);
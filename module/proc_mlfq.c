@@ -0,0 +1,207 @@
+/* Multi-level feedback queue policy: a process starts at the highest level
+ * and moves one level down whenever it keeps the CPU busy for its whole
+ * slice, while one which blocks or yields within its slice keeps its level.
+ * The slice doubles with every level down, so CPU bound processes end up
+ * running rarely but for long, and interactive ones keep running first. To
+ * keep the processes at the bottom from starving, every run queue boosts all
+ * of its processes back to the highest level periodically, every
+ * /proc/sched_plugin/mlfq_boost_ms milliseconds.
+ */
+
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+
+#include "sched_plugin.h"
+
+MODULE_AUTHOR("National Cheng Kung University, Taiwan");
+MODULE_DESCRIPTION("Multi-level feedback queue scheduling policy");
+MODULE_LICENSE("GPL");
+
+#define MLFQ_LEVELS 8 /* Level L runs for a slice of 2^L quanta */
+
+/* Share of its slice a process has to spend on the CPU to be demoted, in
+ * percent. Anything less means that it blocked or yielded in between.
+ */
+#define MLFQ_BUSY_PERCENT 90
+
+/* Period of the priority boost in milliseconds, 0 disables it */
+static unsigned int boost_ms = 1000;
+
+/* Run queue of the feedback queue policy */
+struct mlfq_rq {
+    DECLARE_BITMAP(bitmap, MLFQ_LEVELS); /* Non-empty levels */
+    struct list_head queue[MLFQ_LEVELS]; /* Processes per level */
+    unsigned long last_boost;            /* Time of the last boost, jiffies */
+};
+
+static void *mlfq_alloc_rq(int cpu)
+{
+    struct mlfq_rq *mrq =
+        kmalloc_node(sizeof(*mrq), GFP_KERNEL, cpu_to_node(cpu));
+    int i;
+
+    if (mrq) {
+        bitmap_zero(mrq->bitmap, MLFQ_LEVELS);
+        for (i = 0; i < MLFQ_LEVELS; i++)
+            INIT_LIST_HEAD(&mrq->queue[i]);
+        mrq->last_boost = jiffies;
+    }
+    return mrq;
+}
+
+static void mlfq_free_rq(void *rq)
+{
+    kfree(rq);
+}
+
+static void mlfq_enqueue(void *rq, struct sched_plugin_task *t)
+{
+    struct mlfq_rq *mrq = rq;
+
+    list_add_tail(&t->run_list, &mrq->queue[t->level]);
+    __set_bit(t->level, mrq->bitmap);
+}
+
+static void mlfq_dequeue(void *rq, struct sched_plugin_task *t)
+{
+    struct mlfq_rq *mrq = rq;
+
+    list_del_init(&t->run_list);
+    if (list_empty(&mrq->queue[t->level]))
+        __clear_bit(t->level, mrq->bitmap);
+}
+
+static struct sched_plugin_task *mlfq_pick_next(void *rq)
+{
+    struct mlfq_rq *mrq = rq;
+    int level = find_first_bit(mrq->bitmap, MLFQ_LEVELS);
+
+    if (level >= MLFQ_LEVELS)
+        return NULL;
+    return list_first_entry(&mrq->queue[level], struct sched_plugin_task,
+                            run_list);
+}
+
+/* move every process of the run queue back to the highest level */
+static void mlfq_boost(struct mlfq_rq *mrq, struct sched_plugin_task *curr)
+{
+    int level;
+
+    for_each_set_bit (level, mrq->bitmap, MLFQ_LEVELS) {
+        struct sched_plugin_task *t;
+
+        if (!level)
+            continue;
+        list_for_each_entry (t, &mrq->queue[level], run_list)
+            t->level = 0;
+        list_splice_tail_init(&mrq->queue[level], &mrq->queue[0]);
+        __clear_bit(level, mrq->bitmap);
+        __set_bit(0, mrq->bitmap);
+    }
+    curr->level = 0;
+    curr->slice_ticks = 0;
+    mrq->last_boost = jiffies;
+}
+
+/* Run the process for its slice unless a process of a higher level waits,
+ * and demote it at the end of a slice it kept the CPU busy for
+ */
+static bool mlfq_tick(void *rq, struct sched_plugin_task *curr)
+{
+    struct mlfq_rq *mrq = rq;
+    unsigned int period = READ_ONCE(boost_ms);
+    u64 wall, busy;
+
+    if (period &&
+        time_after_eq(jiffies, mrq->last_boost + msecs_to_jiffies(period)))
+        mlfq_boost(mrq, curr);
+
+    /* A process which blocked ends its slice at its level, uncharged */
+    if (curr->sleeping) {
+        curr->slice_ticks = 0;
+        return true;
+    }
+
+    if (find_first_bit(mrq->bitmap, MLFQ_LEVELS) < curr->level) {
+        curr->slice_ticks = 0;
+        return true;
+    }
+
+    if (++curr->slice_ticks < (1U << curr->level))
+        return false;
+
+    wall = ktime_get_ns() - curr->exec_start;
+    busy = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
+    if (busy * 100 >= wall * MLFQ_BUSY_PERCENT &&
+        curr->level < MLFQ_LEVELS - 1)
+        curr->level++;
+    curr->slice_ticks = 0;
+    return true;
+}
+
+static struct sched_plugin_policy mlfq_policy = {
+    .name = "mlfq",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = mlfq_alloc_rq,
+    .free_rq = mlfq_free_rq,
+    .enqueue = mlfq_enqueue,
+    .dequeue = mlfq_dequeue,
+    .pick_next = mlfq_pick_next,
+    .tick = mlfq_tick,
+};
+
+static int boost_ms_show(struct seq_file *m)
+{
+    seq_printf(m, "%u\n", READ_ONCE(boost_ms));
+    return 0;
+}
+
+static int boost_ms_store(const char *buf)
+{
+    unsigned int val;
+    int ret = kstrtouint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    WRITE_ONCE(boost_ms, val);
+    return 0;
+}
+
+static const struct sched_plugin_tunable boost_tunable = {
+    .name = "mlfq_boost_ms",
+    .show = boost_ms_show,
+    .store = boost_ms_store,
+};
+
+static int __init mlfq_policy_module_init(void)
+{
+    int ret;
+
+    printk(KERN_INFO "Feedback queue policy module is being loaded.\n");
+    ret = sched_plugin_add_tunable(&boost_tunable);
+    if (ret)
+        return ret;
+    ret = sched_plugin_register_policy(&mlfq_policy);
+    if (ret)
+        sched_plugin_remove_tunable(&boost_tunable);
+    return ret;
+}
+
+static void __exit mlfq_policy_module_cleanup(void)
+{
+    printk(KERN_INFO "Feedback queue policy module is being unloaded.\n");
+    sched_plugin_unregister_policy(&mlfq_policy);
+    sched_plugin_remove_tunable(&boost_tunable);
+}
+
+module_init(mlfq_policy_module_init);
+module_exit(mlfq_policy_module_cleanup);
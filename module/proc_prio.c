@@ -0,0 +1,110 @@
+/* Priority policy in the manner of the O(1) Linux scheduler: every run queue
+ * has one FIFO list per priority level and a bitmap of the non-empty ones.
+ * The next process is the first one of the highest non-empty level, found
+ * with a find-first-bit, and the processes of one level take turns every
+ * quantum. A waiting process of a lower level never preempts the running one.
+ */
+
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+
+#include "sched_plugin.h"
+
+MODULE_AUTHOR("National Cheng Kung University, Taiwan");
+MODULE_DESCRIPTION("Priority scheduling policy");
+MODULE_LICENSE("GPL");
+
+/* Run queue of the priority policy */
+struct prio_rq {
+    DECLARE_BITMAP(bitmap, SCHED_PLUGIN_NR_PRIO); /* Non-empty levels */
+    struct list_head queue[SCHED_PLUGIN_NR_PRIO]; /* Processes per level */
+};
+
+static void *prio_alloc_rq(int cpu)
+{
+    struct prio_rq *prq =
+        kmalloc_node(sizeof(*prq), GFP_KERNEL, cpu_to_node(cpu));
+    int i;
+
+    if (prq) {
+        bitmap_zero(prq->bitmap, SCHED_PLUGIN_NR_PRIO);
+        for (i = 0; i < SCHED_PLUGIN_NR_PRIO; i++)
+            INIT_LIST_HEAD(&prq->queue[i]);
+    }
+    return prq;
+}
+
+static void prio_free_rq(void *rq)
+{
+    kfree(rq);
+}
+
+static void prio_enqueue(void *rq, struct sched_plugin_task *t)
+{
+    struct prio_rq *prq = rq;
+
+    list_add_tail(&t->run_list, &prq->queue[t->prio]);
+    __set_bit(t->prio, prq->bitmap);
+}
+
+static void prio_dequeue(void *rq, struct sched_plugin_task *t)
+{
+    struct prio_rq *prq = rq;
+
+    list_del_init(&t->run_list);
+    if (list_empty(&prq->queue[t->prio]))
+        __clear_bit(t->prio, prq->bitmap);
+}
+
+static struct sched_plugin_task *prio_pick_next(void *rq)
+{
+    struct prio_rq *prq = rq;
+    int prio = find_first_bit(prq->bitmap, SCHED_PLUGIN_NR_PRIO);
+
+    if (prio >= SCHED_PLUGIN_NR_PRIO)
+        return NULL;
+    return list_first_entry(&prq->queue[prio], struct sched_plugin_task,
+                            run_list);
+}
+
+/* preempt the running process for a waiting one of the same or a higher
+ * level
+ */
+static bool prio_tick(void *rq, struct sched_plugin_task *curr)
+{
+    struct prio_rq *prq = rq;
+
+    return find_first_bit(prq->bitmap, SCHED_PLUGIN_NR_PRIO) <= curr->prio;
+}
+
+static struct sched_plugin_policy prio_policy = {
+    .name = "prio",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = prio_alloc_rq,
+    .free_rq = prio_free_rq,
+    .enqueue = prio_enqueue,
+    .dequeue = prio_dequeue,
+    .pick_next = prio_pick_next,
+    .tick = prio_tick,
+};
+
+static int __init prio_policy_module_init(void)
+{
+    printk(KERN_INFO "Priority policy module is being loaded.\n");
+    return sched_plugin_register_policy(&prio_policy);
+}
+
+static void __exit prio_policy_module_cleanup(void)
+{
+    printk(KERN_INFO "Priority policy module is being unloaded.\n");
+    sched_plugin_unregister_policy(&prio_policy);
+}
+
+module_init(prio_policy_module_init);
+module_exit(prio_policy_module_cleanup);
@@ -2,291 +2,3215 @@
  * retrieval of process information about a given process.
  */
 
+#include <linux/bitmap.h>
+#include <linux/capability.h>
+#include <linux/cpumask.h>
+#include <linux/cred.h>
+#include <linux/debugfs.h>
 #include <linux/errno.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/indirect_call_wrapper.h>
 #include <linux/init.h>
+#include <linux/irq_work.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/rhashtable.h>
 #include <linux/sched.h>
+#include <linux/sched/prio.h>
 #include <linux/sched/signal.h>
+#include <linux/sched/task.h>
+#include <linux/sched/types.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
 #include <linux/time.h>
+#include <linux/tracepoint.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "sched_plugin.h"
+#include "sched_plugin_state.h"
+
+#define CREATE_TRACE_POINTS
+#include "sched_plugin_trace.h"
 
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
 MODULE_DESCRIPTION("Process queue module");
 MODULE_LICENSE("GPL");
 
-#define ALL_REG_PIDS (-100)
-#define INVALID_PID (-1)
+/* Number of bits of the thread group lookup table */
+#define GANG_HASH_BITS 8
+
+/* Buckets of the latency histograms, bucket i counting the times of 2^(i-1)
+ * to 2^i - 1 microseconds and the last one everything longer
+ */
+#define STATS_BUCKETS 24
+
+/* Number of bits of the notification file lookup table */
+#define NOTIFY_HASH_BITS 6
+
+/* Events kept per notification file until read, the oldest go first */
+#define NOTIFY_EVENTS 64
+
+/* Task records of the shared state area at most, 4 MiB of them */
+#define STATE_SLOTS_MAX (1U << 16)
+
+/* Run state of a task, the field was renamed in 5.14 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 14, 0)
+#define task_run_state(p) READ_ONCE((p)->__state)
+#else
+#define task_run_state(p) READ_ONCE((p)->state)
+#endif
+
+/* Sleep states of a task, as opposed to running or stopped */
+#define TASK_ASLEEP (TASK_INTERRUPTIBLE | TASK_UNINTERRUPTIBLE)
+
+/* Enumeration for Task Errors */
+enum task_status_code {
+    TS_EXIST = 0,      /* Task is still active */
+    TS_TERMINATED = -1 /* Task has terminated */
+};
+
+struct proc_rq;
+
+/* Registered threads of one thread group, scheduled together on separate
+ * CPUs. Written and walked under table_lock.
+ */
+struct proc_gang {
+    int tgid;                 /* Thread group ID */
+    unsigned int nr_members;  /* Number of registered threads */
+    struct list_head members; /* Their nodes */
+    struct hlist_node hnode;  /* Link into the thread group lookup table */
+};
+
+/* Way of keeping a waiting task off its CPU. All callbacks run in process
+ * context with a reference on the task held.
+ */
+struct suspend_backend {
+    const char *name;
+    void (*suspend)(struct task_struct *p);          /* Take the CPU away */
+    void (*resume)(struct task_struct *p, int nice); /* Give the CPU back */
+    void (*release)(struct task_struct *p, int nice); /* Unregister */
+};
+
+/* Structure for a process */
+struct proc {
+    int pid;                   /* Process ID */
+    struct pid *tpid;          /* Counted reference to the PID of the task */
+    const struct suspend_backend *suspend; /* Backend last suspending it */
+    int nice;                  /* Nice value before registration */
+    struct cpumask *cpus_allowed; /* Affinity before registration, if saved */
+    enum process_state state;  /* Process State */
+    struct list_head list;     /* Link into the list of registered processes */
+    struct sched_plugin_task se; /* Entity queued by the scheduling policy */
+    struct rhash_head hnode;   /* Link into the PID lookup table */
+    bool linked;               /* Still in the lookup table, under rq lock */
+    struct proc_rq *rq;        /* Run queue owning the process */
+    struct list_head rq_list;  /* Link into the members of that run queue */
+    int tgid;                  /* Thread group, 0 for none */
+    struct proc_gang *gang;    /* Gang of the thread group, if any */
+    struct list_head gang_list; /* Link into the members of the gang */
+    u64 run_ns;                /* Time given the CPU, up to the last switch */
+    u64 wait_ns;               /* Time spent waiting for the CPU */
+    unsigned long nr_scheduled; /* Times given the CPU */
+    unsigned long nr_involuntary; /* Times preempted while runnable */
+    int state_slot;            /* Task record in the state area, -1 if none */
+    struct rcu_head rcu;       /* Deferred free after the RCU grace period */
+} top;
+
+/* Run queue of one CPU. The waiting processes are ordered by the policy of
+ * the run queue. The node of the running process is kept out of the policy
+ * and is queued again on the next rotation instead of being freed and
+ * allocated again.
+ */
+struct proc_rq {
+    spinlock_t lock;            /* Serializes the writers of this run queue */
+    struct sched_plugin_policy *policy; /* Policy ordering the processes */
+    void *priv;                 /* Run queue state of the policy */
+    void *next_priv;            /* State of a policy being switched to */
+    struct proc *running;       /* Node of the running process */
+    struct pid *running_tpid;   /* Its PID, read by the switch probe */
+    struct irq_work block_work; /* Switch early, the running process blocked */
+    unsigned int nr_queued;     /* Number of processes queued in the policy */
+    unsigned long load_weight;  /* Sum of the weights of those processes */
+    u64 last_wait_ns;           /* Wait of the process picked last, if any */
+    bool last_picked;           /* Last rotation picked a waiting process */
+    int gang_next;              /* Gang member released by another CPU */
+    int yield_pid;              /* Running process asked to give way */
+    u64 last_rotation;          /* Time of the last rotation */
+    unsigned int nr_terminated; /* Nodes marked terminated, not yet reaped */
+    u64 dl_bw;                  /* Bandwidth reserved, under table_lock */
+    struct list_head members;   /* Its registered processes, running or not */
+    int cpu;                    /* CPU owning the run queue */
+};
+
+static DEFINE_PER_CPU(struct proc_rq, proc_rqs);
+
+/* Run queue of the built-in policies, a FIFO list of the waiting processes */
+struct fifo_rq {
+    struct list_head queue;
+};
+
+/* Round robin keeps its run queues in static per-CPU storage, so falling back
+ * to it when a policy module goes away cannot fail
+ */
+static DEFINE_PER_CPU(struct fifo_rq, rr_rqs);
+
+/* CPUs given a run queue, all online CPUs unless restricted by "cpus" */
+static struct cpumask plugin_cpus;
+static char *cpus;
+module_param(cpus, charp, 0);
+MODULE_PARM_DESC(cpus, "List of CPUs running registered processes");
+
+/* PID to proc lookup table. Together with the list of registered processes
+ * headed by top it is written under table_lock, nested inside the run queue
+ * lock, and read under RCU. Both never reorder, so readers walking them are
+ * not disturbed by rotations or by processes moving between run queues. The
+ * table grows and shrinks along with the number of registered processes, so
+ * a lookup stays O(1) however many there are.
+ */
+static struct rhashtable proc_table;
+static const struct rhashtable_params proc_params = {
+    .key_len = sizeof(int),
+    .key_offset = offsetof(struct proc, pid),
+    .head_offset = offsetof(struct proc, hnode),
+    .automatic_shrinking = true,
+};
+static DEFINE_SPINLOCK(table_lock);
+
+/* Thread group to gang lookup table, under table_lock */
+static DEFINE_HASHTABLE(gang_table, GANG_HASH_BITS);
+
+/* Whether the threads of a thread group are scheduled as a gang: a CPU
+ * giving one of them the CPU releases the others on their CPUs, and one
+ * preempting it deschedules them.
+ */
+static bool gang_sched = true;
+module_param(gang_sched, bool, 0);
+MODULE_PARM_DESC(gang_sched, "Co-schedule the threads of a thread group");
+
+/* Registered policies and the one every run queue is switched to. Both are
+ * changed under policy_mutex.
+ */
+static LIST_HEAD(policies);
+static DEFINE_MUTEX(policy_mutex);
+static struct sched_plugin_policy *active_policy;
+static char *default_policy = "rr";
+module_param_named(policy, default_policy, charp, 0);
+MODULE_PARM_DESC(policy, "Scheduling policy at load time, rr or fifo");
+
+/* Number of registered processes and its runtime tunable upper bound, zero
+ * meaning unlimited. The count is updated under table_lock.
+ */
+static unsigned int nr_registered;
+static unsigned int max_tasks;
+module_param(max_tasks, uint, 0);
+
+/* Runtime tunable upper bound of the CPU bandwidth reserved by the
+ * processes of a run queue, in percent of its CPU. A registration or a
+ * reservation exceeding the bound on the run queue of the process is
+ * refused.
+ */
+static unsigned int dl_bound = 95;
+module_param(dl_bound, uint, 0);
+MODULE_PARM_DESC(dl_bound, "Bandwidth reservable in percent of each CPU");
+
+/* Latency histograms shown in /proc/sched_plugin/stats. They are per CPU,
+ * each rotation counting into the one of the CPU it runs on without a lock,
+ * and only summed up when read.
+ */
+struct sched_stats {
+    unsigned long wait_hist[STATS_BUCKETS]; /* Waits for the CPU */
+    unsigned long tick_hist[STATS_BUCKETS]; /* Times between rotations */
+};
+
+static DEFINE_PER_CPU(struct sched_stats, sched_stats);
+
+/* Area mapped read-only by user space from /proc/sched_plugin/state, laid
+ * out as described in sched_plugin_state.h. The CPU records are written
+ * under the run queue locks, a task record under the lock of the run queue
+ * owning the process, and the header together with the bitmap of the task
+ * records taken under table_lock. A record changes hands only under
+ * table_lock, so its writers never overlap.
+ */
+static void *state_area;
+static unsigned long *state_map;
+static unsigned int state_slots = 1024;
+module_param(state_slots, uint, 0);
+MODULE_PARM_DESC(state_slots, "Processes shown in /proc/sched_plugin/state");
+
+/* Notification file of a task, one per open of /proc/sched_plugin/notify.
+ * The events of the task are queued in order, under the lock of the wait
+ * queue, since they are sent from the rotations and from a timer.
+ */
+struct proc_notify {
+    int pid;                       /* Task the file was opened by */
+    u64 lead_ns;                   /* Warning ahead of the quantum end */
+    u8 events[NOTIFY_EVENTS];      /* Ring of enum sched_plugin_notify */
+    unsigned int head, tail;       /* Events sent and read */
+    wait_queue_head_t wait;        /* Readers and pollers of the file */
+    struct hlist_node hnode;       /* Link into the notification table */
+    struct rcu_head rcu;
+};
+
+/* PID to notification file lookup table, written under notify_lock and
+ * read under RCU. nr_notify spares the lookups while no file is open.
+ */
+static DEFINE_HASHTABLE(notify_table, NOTIFY_HASH_BITS);
+static DEFINE_SPINLOCK(notify_lock);
+static unsigned int nr_notify;
+static bool notify_closing;
+
+static const char *const notify_names[SCHED_NOTIFY_NR] = {
+    [SCHED_NOTIFY_IN] = "in",
+    [SCHED_NOTIFY_OUT_SOON] = "out_soon",
+    [SCHED_NOTIFY_OUT] = "out",
+};
+
+/* Logging level shared by all the modules. The static keys tested by the
+ * logging macros follow it, they are switched under log_mutex.
+ */
+int sched_plugin_log_level = SCHED_LOG_ERR;
+module_param_named(log_level, sched_plugin_log_level, int, 0);
+DEFINE_STATIC_KEY_FALSE(sched_plugin_info_key);
+DEFINE_STATIC_KEY_FALSE(sched_plugin_debug_key);
+DEFINE_STATIC_KEY_FALSE(sched_plugin_event_key);
+static DEFINE_MUTEX(log_mutex);
+
+/* Event recorded in the ring of a CPU. seq is the position of the event in
+ * the ring plus one, written last, so a reader can tell a complete event
+ * from one being overwritten.
+ */
+struct plugin_event {
+    unsigned long seq;
+    u64 ts;   /* Time of the event in nanoseconds */
+    int type; /* enum sched_plugin_event_type */
+    int pid;
+    int arg;
+};
+
+/* Per CPU ring of the latest events, overwritten once full. A writer only
+ * writes the ring of the CPU it runs on and claims its slot with a per CPU
+ * increment, so interrupts nesting on that CPU get slots of their own and
+ * no lock is needed.
+ */
+struct event_ring {
+    struct plugin_event *events; /* event_ring_size slots */
+    unsigned long head;          /* Number of events ever claimed */
+    int cpu;                     /* CPU writing the ring */
+};
+
+static DEFINE_PER_CPU(struct event_ring, event_rings);
+
+/* Events per CPU, rounded up to a power of two when the rings are allocated
+ * on the first enabling
+ */
+static unsigned int event_ring_size = 1024;
+module_param(event_ring_size, uint, 0);
+MODULE_PARM_DESC(event_ring_size, "Events kept per CPU in the debugfs ring");
+
+static bool events_allocated;
+static struct dentry *debugfs_dir;
+
+static const char *const event_names[EV_NR_TYPES] = {
+    [EV_REGISTER] = "register", [EV_REMOVE] = "remove",
+    [EV_EXIT] = "exit",         [EV_SWITCH] = "switch",
+    [EV_BLOCK] = "block",       [EV_STATE] = "state",
+    [EV_MIGRATE] = "migrate",
+};
+
+/* Control directory /proc/sched_plugin holding the runtime tunables */
+static struct proc_dir_entry *sched_plugin_dir;
+
+/* Slab cache backing every struct proc */
+static struct kmem_cache *proc_cache;
+
+/* Node allocation counters, a steady state rotation leaves both unchanged.
+ * They are updated under table_lock.
+ */
+static unsigned long nr_allocs, nr_frees;
+module_param(nr_allocs, ulong, 0444);
+module_param(nr_frees, ulong, 0444);
+
+/* Tracepoint fired by every exiting task, looked up at load time since it is
+ * not exported to modules
+ */
+static struct tracepoint *exit_tracepoint;
+
+/* Tracepoint fired by every context switch, telling when the running process
+ * of a run queue blocks
+ */
+static struct tracepoint *switch_tracepoint;
+
+/* Waiting processes skipped at most per rotation because they are asleep,
+ * which only those suspended by the idle backend can be
+ */
+#define PICK_SKIP_MAX 8
+
+/* Called with the CPU whose running process exited or blocked, so that the
+ * scheduler hands the CPU on without waiting for the end of the quantum
+ */
+static void (__rcu *resched_hook)(int cpu);
+
+/* Called with the CPU a process was registered on, so that the scheduler
+ * restarts a tick it stopped
+ */
+static void (__rcu *kick_hook)(int cpu);
+
+#ifdef SCHED_PLUGIN_BENCH
+/* Set while the self benchmark runs: synthetic PIDs count as live tasks and
+ * are never signalled.
+ */
+static bool bench_running;
+#endif
+
+/* stop and continue the whole thread group through job control signals */
+static void signal_suspend(struct task_struct *p)
+{
+    kill_pid(task_pid(p), SIGSTOP, 1);
+}
+
+static void signal_resume(struct task_struct *p, int nice)
+{
+    kill_pid(task_pid(p), SIGCONT, 1);
+}
+
+static void signal_release(struct task_struct *p, int nice)
+{
+    kill_pid(task_pid(p), SIGCONT, 1);
+}
+
+static void idle_setattr(struct task_struct *p, int policy, int nice)
+{
+    struct sched_attr attr = {
+        .size = sizeof(attr),
+        .sched_policy = policy,
+        .sched_nice = nice,
+    };
+
+    sched_setattr_nocheck(p, &attr);
+}
+
+/* demote the registered thread alone to SCHED_IDLE, so that it only gets the
+ * CPU time no other task wants, and give it its nice level of registration
+ * back while it holds its quantum. It is never raised above that level, the
+ * checks sched_setattr_nocheck skips were made at registration. No signal is
+ * delivered, the application does not notice.
+ */
+static void idle_suspend(struct task_struct *p)
+{
+    idle_setattr(p, SCHED_IDLE, 0);
+}
+
+static void idle_resume(struct task_struct *p, int nice)
+{
+    idle_setattr(p, SCHED_NORMAL, nice);
+}
+
+static void idle_release(struct task_struct *p, int nice)
+{
+    idle_setattr(p, SCHED_NORMAL, nice);
+}
+
+static const struct suspend_backend suspend_backends[] = {
+    {
+        .name = "signal",
+        .suspend = signal_suspend,
+        .resume = signal_resume,
+        .release = signal_release,
+    },
+    {
+        .name = "idle",
+        .suspend = idle_suspend,
+        .resume = idle_resume,
+        .release = idle_release,
+    },
+};
+
+static void *rr_alloc_rq(int cpu)
+{
+    struct fifo_rq *frq = per_cpu_ptr(&rr_rqs, cpu);
+
+    INIT_LIST_HEAD(&frq->queue);
+    return frq;
+}
+
+static void *fifo_alloc_rq(int cpu)
+{
+    struct fifo_rq *frq =
+        kmalloc_node(sizeof(*frq), GFP_KERNEL, cpu_to_node(cpu));
+
+    if (frq)
+        INIT_LIST_HEAD(&frq->queue);
+    return frq;
+}
+
+static void fifo_free_rq(void *rq)
+{
+    kfree(rq);
+}
+
+static void fifo_enqueue(void *rq, struct sched_plugin_task *t)
+{
+    struct fifo_rq *frq = rq;
+
+    list_add_tail(&t->run_list, &frq->queue);
+}
+
+static void fifo_dequeue(void *rq, struct sched_plugin_task *t)
+{
+    list_del_init(&t->run_list);
+}
+
+static struct sched_plugin_task *fifo_pick_next(void *rq)
+{
+    struct fifo_rq *frq = rq;
+
+    return list_first_entry_or_null(&frq->queue, struct sched_plugin_task,
+                                    run_list);
+}
+
+/* round robin preempts every quantum, FIFO runs a process to completion */
+static bool rr_tick(void *rq, struct sched_plugin_task *curr)
+{
+    return true;
+}
+
+static bool fifo_tick(void *rq, struct sched_plugin_task *curr)
+{
+    return false;
+}
+
+static struct sched_plugin_policy rr_policy = {
+    .name = "rr",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = rr_alloc_rq,
+    .enqueue = fifo_enqueue,
+    .dequeue = fifo_dequeue,
+    .pick_next = fifo_pick_next,
+    .tick = rr_tick,
+};
+
+static struct sched_plugin_policy fifo_policy = {
+    .name = "fifo",
+    .suspend = SUSPEND_SIGNAL,
+    .alloc_rq = fifo_alloc_rq,
+    .free_rq = fifo_free_rq,
+    .enqueue = fifo_enqueue,
+    .dequeue = fifo_dequeue,
+    .pick_next = fifo_pick_next,
+    .tick = fifo_tick,
+};
+
+/* Calls into the policy of a run queue, whose lock must be held. The list
+ * operations of the built-in policies are called directly, sparing the tick
+ * an indirect call for them.
+ */
+static void policy_enqueue(struct proc_rq *rq, struct proc *node)
+{
+    INDIRECT_CALL_1(rq->policy->enqueue, fifo_enqueue, rq->priv, &node->se);
+    rq->nr_queued++;
+    rq->load_weight += node->se.weight;
+}
+
+static void policy_dequeue(struct proc_rq *rq, struct proc *node)
+{
+    INDIRECT_CALL_1(rq->policy->dequeue, fifo_dequeue, rq->priv, &node->se);
+    rq->nr_queued--;
+    rq->load_weight -= node->se.weight;
+}
+
+static struct proc *policy_pick_next(struct proc_rq *rq)
+{
+    struct sched_plugin_task *t = INDIRECT_CALL_1(
+        rq->policy->pick_next, fifo_pick_next, rq->priv);
+
+    return t ? container_of(t, struct proc, se) : NULL;
+}
+
+static bool policy_tick(struct proc_rq *rq, struct proc *node)
+{
+    return INDIRECT_CALL_2(rq->policy->tick, rr_tick, fifo_tick, rq->priv,
+                           &node->se);
+}
+
+static void policy_task_exit(struct proc_rq *rq, struct proc *node)
+{
+    if (rq->policy->task_exit)
+        rq->policy->task_exit(rq->priv, &node->se);
+}
+
+static void policy_free_rq(struct sched_plugin_policy *policy, void *priv)
+{
+    if (policy->free_rq)
+        policy->free_rq(priv);
+}
+
+/* look up a registered policy by name, policy_mutex must be held */
+static struct sched_plugin_policy *find_policy(const char *name)
+{
+    struct sched_plugin_policy *policy;
+
+    list_for_each_entry (policy, &policies, list) {
+        if (!strcmp(policy->name, name))
+            return policy;
+    }
+    return NULL;
+}
+
+/* move every run queue over to another policy, policy_mutex must be held.
+ * The waiting processes are handed over in the order the old policy would
+ * have run them, the running one is queued by the new policy once preempted.
+ */
+static int switch_policy(struct sched_plugin_policy *new)
+{
+    struct sched_plugin_policy *old = active_policy;
+    struct proc_rq *rq;
+    struct proc *node;
+    void *old_priv;
+    int cpu;
+
+    if (new == old)
+        return 0;
+
+    /* Allocate everything up front so that the switch cannot fail midway */
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        rq->next_priv = new->alloc_rq ? new->alloc_rq(cpu) : NULL;
+        if (new->alloc_rq && !rq->next_priv) {
+            for_each_cpu (cpu, &plugin_cpus) {
+                rq = per_cpu_ptr(&proc_rqs, cpu);
+                if (rq->next_priv)
+                    policy_free_rq(new, rq->next_priv);
+                rq->next_priv = NULL;
+            }
+            return -ENOMEM;
+        }
+    }
+
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        spin_lock(&rq->lock);
+        while ((node = policy_pick_next(rq))) {
+            old->dequeue(rq->priv, &node->se);
+            policy_task_exit(rq, node);
+            new->enqueue(rq->next_priv, &node->se);
+        }
+        if (rq->running)
+            policy_task_exit(rq, rq->running);
+        old_priv = rq->priv;
+        rq->policy = new;
+        rq->priv = rq->next_priv;
+        rq->next_priv = NULL;
+        spin_unlock(&rq->lock);
+        policy_free_rq(old, old_priv);
+    }
+
+    active_policy = new;
+    plugin_info("Scheduling policy switched from %s to %s\n", old->name,
+                new->name);
+    return 0;
+}
+
+/* make a scheduling policy selectable through /proc/sched_plugin/policy */
+int sched_plugin_register_policy(struct sched_plugin_policy *policy)
+{
+    int ret = 0;
+
+    mutex_lock(&policy_mutex);
+    if (find_policy(policy->name))
+        ret = -EEXIST;
+    else
+        list_add_tail(&policy->list, &policies);
+    mutex_unlock(&policy_mutex);
+
+    if (!ret)
+        plugin_info("Scheduling policy %s registered\n", policy->name);
+    return ret;
+}
+
+/* withdraw a scheduling policy, the run queues fall back to round robin when
+ * it is the active one
+ */
+void sched_plugin_unregister_policy(struct sched_plugin_policy *policy)
+{
+    mutex_lock(&policy_mutex);
+    if (active_policy == policy)
+        switch_policy(&rr_policy);
+    list_del(&policy->list);
+    mutex_unlock(&policy_mutex);
+}
+
+enum task_status_code task_status_change(
+    struct pid *pid,
+    const struct suspend_backend *backend,
+    int nice,
+    enum process_state eState);
+static void task_release(struct pid *pid,
+                         const struct suspend_backend *backend,
+                         int nice);
+
+int init_process_queue(void);
+int release_process_queue(void);
+
+/* look up the node of a registered PID, either table_lock or the RCU read
+ * lock must be held
+ */
+static struct proc *find_process_in_queue(int pid)
+{
+    return rhashtable_lookup_fast(&proc_table, &pid, proc_params);
+}
+
+/* look up a registered PID and lock the run queue owning it, the node may
+ * move to another run queue until that lock is taken
+ */
+static struct proc_rq *lock_process_rq(int pid, struct proc **pnode)
+{
+    struct proc_rq *rq = NULL;
+    struct proc *node;
+
+    rcu_read_lock();
+    while ((node = find_process_in_queue(pid))) {
+        rq = READ_ONCE(node->rq);
+        spin_lock(&rq->lock);
+        if (node->rq == rq && node->linked)
+            break;
+        spin_unlock(&rq->lock);
+        rq = NULL;
+    }
+    rcu_read_unlock();
+
+    *pnode = node;
+    return rq;
+}
+
+/* lock two run queues in CPU order */
+static void double_lock_rq(struct proc_rq *a, struct proc_rq *b)
+{
+    if (a->cpu > b->cpu)
+        swap(a, b);
+    spin_lock(&a->lock);
+    spin_lock_nested(&b->lock, SINGLE_DEPTH_NESTING);
+}
+
+static void double_unlock_rq(struct proc_rq *a, struct proc_rq *b)
+{
+    spin_unlock(&a->lock);
+    spin_unlock(&b->lock);
+}
+
+/* allocate a node from the proc slab cache, holding a reference to the PID
+ * of the task for as long as the node lives
+ */
+static struct proc *alloc_process(int pid)
+{
+    struct proc *node = kmem_cache_alloc(proc_cache, GFP_KERNEL);
+
+    if (node) {
+        node->pid = pid;
+        node->tpid = find_get_pid(pid);
+        node->suspend = NULL;
+        node->nice = 0;
+        node->cpus_allowed = NULL;
+        node->state = S_WAITING;
+        node->rq = NULL;
+        node->linked = false;
+        node->tgid = 0;
+        node->gang = NULL;
+        node->run_ns = 0;
+        node->wait_ns = 0;
+        node->nr_scheduled = 0;
+        node->nr_involuntary = 0;
+        node->state_slot = -1;
+        INIT_LIST_HEAD(&node->gang_list);
+        INIT_LIST_HEAD(&node->se.run_list);
+        RB_CLEAR_NODE(&node->se.run_node);
+        node->se.exec_start = 0;
+        node->se.sum_exec_runtime = 0;
+        node->se.prev_sum_exec_runtime = 0;
+        node->se.delta_exec = 0;
+        node->se.wait_start = 0;
+        node->se.vruntime = 0;
+        node->se.weight = SCHED_PLUGIN_WEIGHT_DEFAULT;
+        node->se.prio = SCHED_PLUGIN_PRIO_DEFAULT;
+        node->se.level = 0;
+        node->se.slice_ticks = 0;
+        node->se.sleeping = false;
+        node->se.dl_runtime = 0;
+        node->se.dl_deadline = 0;
+        node->se.dl_period = 0;
+        node->se.deadline = 0;
+        node->se.dl_release = 0;
+        node->se.budget = 0;
+        node->se.dl_throttled = false;
+        node->se.nr_jobs = 0;
+        node->se.nr_missed = 0;
+        node->se.tickets = SCHED_PLUGIN_TICKETS_DEFAULT;
+        node->se.lottery_slot = 0;
+    }
+    return node;
+}
+
+/* give a node which was never linked back to the proc slab cache */
+static void free_process(struct proc *node)
+{
+    kfree(node->cpus_allowed);
+    put_pid(node->tpid);
+    kmem_cache_free(proc_cache, node);
+}
+
+/* give an unlinked node back once no RCU reader can see it any more */
+static void free_process_rcu(struct rcu_head *rcu)
+{
+    free_process(container_of(rcu, struct proc, rcu));
+}
+
+/* Make a record of the state area odd before changing it, readers retry
+ * until state_write_end makes it even again
+ */
+static void state_write_begin(__u32 *seq)
+{
+    WRITE_ONCE(*seq, *seq + 1);
+    smp_wmb();
+}
+
+static void state_write_end(__u32 *seq)
+{
+    smp_wmb();
+    WRITE_ONCE(*seq, *seq + 1);
+}
+
+static struct sched_state_header *state_header(void)
+{
+    return state_area;
+}
+
+static struct sched_state_cpu *state_cpu(int cpu)
+{
+    struct sched_state_header *hdr = state_header();
+
+    return state_area + hdr->cpu_offset + cpu * hdr->cpu_size;
+}
+
+static struct sched_state_task *state_task(int slot)
+{
+    struct sched_state_header *hdr = state_header();
+
+    return state_area + hdr->task_offset + slot * hdr->task_size;
+}
+
+/* Publish the run queue of a CPU, after a rotation if rotated, and one
+ * giving the CPU to another process if switched. The run queue lock must be
+ * held.
+ */
+static void state_publish_rq(struct proc_rq *rq, bool rotated, bool switched)
+{
+    struct sched_state_cpu *sc;
+
+    if (!state_area)
+        return;
+    sc = state_cpu(rq->cpu);
+    state_write_begin(&sc->seq);
+    sc->running_pid = rq->running ? rq->running->pid : INVALID_PID;
+    sc->nr_queued = rq->nr_queued;
+    if (rotated) {
+        sc->nr_rotations++;
+        sc->last_rotation = rq->last_rotation;
+    }
+    if (switched)
+        sc->nr_switches++;
+    state_write_end(&sc->seq);
+}
+
+/* publish the counters of a process, the lock of its run queue or, for a
+ * record changing hands, table_lock must be held
+ */
+static void state_publish_task(struct proc *node)
+{
+    struct sched_state_task *st;
+
+    if (!state_area || node->state_slot < 0)
+        return;
+    st = state_task(node->state_slot);
+    state_write_begin(&st->seq);
+    st->pid = node->pid;
+    st->tgid = node->tgid;
+    st->cpu = node->rq->cpu;
+    st->state = node->state;
+    st->run_ns = node->run_ns;
+    st->wait_ns = node->wait_ns;
+    st->nr_scheduled = node->nr_scheduled;
+    st->nr_involuntary = node->nr_involuntary;
+    state_write_end(&st->seq);
+}
+
+/* publish the number of registered processes, table_lock must be held */
+static void state_publish_header(unsigned int nr_unslotted)
+{
+    struct sched_state_header *hdr = state_header();
+
+    state_write_begin(&hdr->seq);
+    hdr->nr_tasks = nr_registered;
+    hdr->nr_unslotted = nr_unslotted;
+    hdr->generation++;
+    state_write_end(&hdr->seq);
+}
+
+/* give a newly linked node a task record if one is free, table_lock must be
+ * held
+ */
+static void state_take_slot(struct proc *node)
+{
+    struct sched_state_header *hdr;
+    unsigned int slot;
+
+    if (!state_area)
+        return;
+    hdr = state_header();
+    slot = find_first_zero_bit(state_map, hdr->nr_slots);
+    if (slot < hdr->nr_slots) {
+        __set_bit(slot, state_map);
+        node->state_slot = slot;
+        state_publish_task(node);
+    }
+    state_publish_header(hdr->nr_unslotted + (node->state_slot < 0));
+}
+
+/* free the task record of a node being unlinked, table_lock must be held */
+static void state_release_slot(struct proc *node)
+{
+    struct sched_state_header *hdr;
+    struct sched_state_task *st;
+
+    if (!state_area)
+        return;
+    hdr = state_header();
+    if (node->state_slot < 0) {
+        state_publish_header(hdr->nr_unslotted - 1);
+        return;
+    }
+    st = state_task(node->state_slot);
+    state_write_begin(&st->seq);
+    st->pid = 0;
+    state_write_end(&st->seq);
+    __clear_bit(node->state_slot, state_map);
+    node->state_slot = -1;
+    state_publish_header(hdr->nr_unslotted);
+}
+
+/* change the state of a node, the lock of its run queue must be held */
+static void set_process_state(struct proc_rq *rq,
+                              struct proc *node,
+                              enum process_state state)
+{
+    trace_sched_plugin_state(node->pid, node->state, state, rq->nr_queued);
+    node->state = state;
+    state_publish_task(node);
+}
+
+/* mark a node as terminated so that the next sweep reaps it */
+static void mark_process_terminated(struct proc_rq *rq, struct proc *node)
+{
+    if (node->state != S_TERMINATED) {
+        set_process_state(rq, node, S_TERMINATED);
+        rq->nr_terminated++;
+    }
+}
+
+/* CPU bandwidth of a reservation of runtime every period */
+static u64 reservation_bw(u64 runtime, u64 period)
+{
+    return period ? div64_u64(runtime << SCHED_PLUGIN_BW_SHIFT, period) : 0;
+}
+
+/* whether a run queue has room for another bandwidth within dl_bound,
+ * table_lock must be held
+ */
+static bool rq_bw_fits(struct proc_rq *rq, u64 old_bw, u64 new_bw)
+{
+    u64 cap = div_u64((u64) READ_ONCE(dl_bound) << SCHED_PLUGIN_BW_SHIFT, 100);
+
+    return new_bw <= old_bw || rq->dl_bw - old_bw + new_bw <= cap;
+}
+
+/* replace a bandwidth reserved on a run queue by another one unless the new
+ * total of the run queue exceeds dl_bound, table_lock must be held
+ */
+static int reserve_bw(struct proc_rq *rq, u64 old_bw, u64 new_bw)
+{
+    if (!rq_bw_fits(rq, old_bw, new_bw))
+        return -EBUSY;
+    rq->dl_bw = rq->dl_bw - old_bw + new_bw;
+    return 0;
+}
+
+/* look up the gang of a thread group, table_lock must be held */
+static struct proc_gang *find_gang(int tgid)
+{
+    struct proc_gang *gang;
+
+    hash_for_each_possible (gang_table, gang, hnode, tgid) {
+        if (gang->tgid == tgid)
+            return gang;
+    }
+    return NULL;
+}
+
+/* Add a node to the gang of its thread group, table_lock must be held. The
+ * caller holds a run queue lock, so a new gang cannot sleep to be allocated;
+ * should that fail, the thread is scheduled on its own.
+ */
+static void gang_join(struct proc *node)
+{
+    struct proc_gang *gang;
+
+    if (!node->tgid)
+        return;
+    gang = find_gang(node->tgid);
+    if (!gang) {
+        gang = kmalloc(sizeof(*gang), GFP_ATOMIC | __GFP_NOWARN);
+        if (!gang)
+            return;
+        gang->tgid = node->tgid;
+        gang->nr_members = 0;
+        INIT_LIST_HEAD(&gang->members);
+        hash_add(gang_table, &gang->hnode, gang->tgid);
+    }
+    list_add_tail(&node->gang_list, &gang->members);
+    gang->nr_members++;
+    node->gang = gang;
+}
+
+/* take a node out of its gang, table_lock must be held */
+static void gang_leave(struct proc *node)
+{
+    struct proc_gang *gang = node->gang;
+
+    if (!gang)
+        return;
+    list_del_init(&node->gang_list);
+    node->gang = NULL;
+    if (!--gang->nr_members) {
+        hash_del(&gang->hnode);
+        kfree(gang);
+    }
+}
+
+/* number of members of a gang on a run queue, table_lock must be held */
+static unsigned int gang_members_on(struct proc_gang *gang,
+                                    struct proc_rq *rq)
+{
+    unsigned int nr = 0;
+    struct proc *node;
+
+    list_for_each_entry (node, &gang->members, gang_list) {
+        if (READ_ONCE(node->rq) == rq)
+            nr++;
+    }
+    return nr;
+}
+
+/* Hand the other members of the gang of a node to their CPUs: released
+ * ones are switched to right away, descheduled ones are switched out. A
+ * member sharing the run queue of the node cannot run alongside it and is
+ * left alone. The run queue lock of the node must be held.
+ */
+static void gang_signal(struct proc_rq *rq, struct proc *node, bool release)
+{
+    void (*resched)(int cpu);
+    struct proc_rq *other;
+    struct proc *member;
+
+    if (!node->gang || !READ_ONCE(gang_sched))
+        return;
+
+    spin_lock(&table_lock);
+    if (node->gang->nr_members < 2) {
+        spin_unlock(&table_lock);
+        return;
+    }
+    rcu_read_lock();
+    resched = rcu_dereference(resched_hook);
+    list_for_each_entry (member, &node->gang->members, gang_list) {
+        other = READ_ONCE(member->rq);
+        if (member == node || other == rq)
+            continue;
+        /* The state of a member is only a hint without the lock of its run
+         * queue, the CPU owning it checks the request again
+         */
+        if (release && READ_ONCE(member->state) != S_RUNNING)
+            WRITE_ONCE(other->gang_next, member->pid);
+        else if (!release && READ_ONCE(member->state) == S_RUNNING)
+            WRITE_ONCE(other->yield_pid, member->pid);
+        else
+            continue;
+        if (resched)
+            resched(other->cpu);
+    }
+    rcu_read_unlock();
+    spin_unlock(&table_lock);
+}
+
+/* Gang member a run queue was asked to switch to, if it still waits there.
+ * The run queue lock must be held.
+ */
+static struct proc *gang_released(struct proc_rq *rq)
+{
+    int pid = xchg(&rq->gang_next, 0);
+    struct proc *node;
+
+    if (!pid)
+        return NULL;
+    rcu_read_lock();
+    node = find_process_in_queue(pid);
+    if (node && (node->rq != rq || node == rq->running ||
+                 node->state == S_TERMINATED))
+        node = NULL;
+    rcu_read_unlock();
+    return node;
+}
+
+/* link a freshly allocated node at the tail of a run queue and into the
+ * lookup table, the run queue lock must be held. Fails with -EEXIST when the
+ * PID is registered already, with -ENOSPC when max_tasks is reached and with
+ * -EBUSY when its reservation does not fit in dl_bound.
+ */
+static int link_process(struct proc_rq *rq, struct proc *node)
+{
+    u64 bw = reservation_bw(node->se.dl_runtime, node->se.dl_period);
+
+    /* Readers of the registered list dereference the run queue */
+    node->rq = rq;
+
+    spin_lock(&table_lock);
+    if (find_process_in_queue(node->pid)) {
+        spin_unlock(&table_lock);
+        return -EEXIST;
+    }
+    if (READ_ONCE(max_tasks) && nr_registered >= READ_ONCE(max_tasks)) {
+        spin_unlock(&table_lock);
+        return -ENOSPC;
+    }
+    if (reserve_bw(rq, 0, bw)) {
+        spin_unlock(&table_lock);
+        return -EBUSY;
+    }
+    /* A node is only made visible once it cannot fail any more, it is freed
+     * without waiting for the readers otherwise
+     */
+    if (rhashtable_insert_fast(&proc_table, &node->hnode, proc_params)) {
+        reserve_bw(rq, bw, 0);
+        spin_unlock(&table_lock);
+        return -ENOMEM;
+    }
+    node->linked = true;
+    list_add_tail_rcu(&(node->list), &(top.list));
+    gang_join(node);
+    nr_registered++;
+    nr_allocs++;
+    state_take_slot(node);
+    spin_unlock(&table_lock);
+    list_add_tail(&node->rq_list, &rq->members);
+
+    /* Hand the new process to the policy. A task suspended ahead of being
+     * queued keeps the backend it was suspended with, any other one takes
+     * the backend of that policy.
+     */
+    if (!node->suspend)
+        node->suspend = &suspend_backends[rq->policy->suspend];
+    node->se.wait_start = ktime_get_ns();
+    policy_enqueue(rq, node);
+    trace_sched_plugin_enqueue(node->pid, rq->cpu, rq->nr_queued);
+    state_publish_rq(rq, false, false);
+    return 0;
+}
+
+/* make a node the running one of its run queue, or none when NULL. The run
+ * queue lock must be held.
+ */
+static void set_running(struct proc_rq *rq, struct proc *node)
+{
+    rq->running = node;
+    WRITE_ONCE(rq->running_tpid, node ? node->tpid : NULL);
+}
+
+/* unlink a node from its run queue and the lookup table and free it after a
+ * grace period, the run queue lock must be held
+ */
+static void unlink_process(struct proc_rq *rq, struct proc *node)
+{
+    if (node->state == S_TERMINATED)
+        rq->nr_terminated--;
+    /* Take the node out of the policy, the running node is not queued */
+    if (node == rq->running)
+        set_running(rq, NULL);
+    else
+        policy_dequeue(rq, node);
+    policy_task_exit(rq, node);
+    list_del(&node->rq_list);
+    trace_sched_plugin_remove(node->pid, rq->cpu, rq->nr_queued);
+    state_publish_rq(rq, false, false);
+
+    spin_lock(&table_lock);
+    list_del_rcu(&node->list);
+    rhashtable_remove_fast(&proc_table, &node->hnode, proc_params);
+    node->linked = false;
+    gang_leave(node);
+    reserve_bw(rq, reservation_bw(node->se.dl_runtime, node->se.dl_period),
+               0);
+    nr_registered--;
+    nr_frees++;
+    state_release_slot(node);
+    spin_unlock(&table_lock);
+
+    /* Removing the whole node */
+    call_rcu(&node->rcu, free_process_rcu);
+}
+
+/* CPU time consumed by the task of a node, as accounted by the kernel */
+static u64 task_exec_runtime(struct proc *node)
+{
+    struct task_struct *task;
+    u64 runtime = 0;
+
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench_running)
+        return 0;
+#endif
+    rcu_read_lock();
+    task = pid_task(node->tpid, PIDTYPE_PID);
+    if (task)
+        runtime = READ_ONCE(task->se.sum_exec_runtime);
+    rcu_read_unlock();
+    return runtime;
+}
+
+/* whether the task of a node sleeps on its own account. A task stopped by
+ * the signal backend does not count, whether it would sleep is unknown.
+ */
+static bool task_asleep(struct proc *node)
+{
+    struct task_struct *task;
+    bool asleep = false;
+
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench_running)
+        return false;
+#endif
+    rcu_read_lock();
+    task = pid_task(node->tpid, PIDTYPE_PID);
+    if (task)
+        asleep = task_run_state(task) & TASK_ASLEEP;
+    rcu_read_unlock();
+    return asleep;
+}
+
+/* start the run time accounting of a process given the CPU */
+static void start_curr(struct proc *node)
+{
+    node->se.exec_start = ktime_get_ns();
+    node->se.sleeping = false;
+    node->se.sum_exec_runtime = task_exec_runtime(node);
+    node->se.prev_sum_exec_runtime = node->se.sum_exec_runtime;
+    node->se.delta_exec = 0;
+}
+
+/* account the CPU time the running process consumed since the last tick */
+static void update_curr(struct proc *node)
+{
+    u64 runtime = task_exec_runtime(node);
+
+    node->se.delta_exec = runtime > node->se.sum_exec_runtime
+                              ? runtime - node->se.sum_exec_runtime
+                              : 0;
+    node->se.sum_exec_runtime += node->se.delta_exec;
+}
+
+/* Run queue a newly registered process goes to: the least loaded one among
+ * those holding the fewest threads of its thread group, so that a gang is
+ * spread over separate CPUs. The processes of a batch placed already but not
+ * linked yet are counted through the per-CPU arrays placed_load and
+ * placed_members, which are NULL for a single registration. Only the run
+ * queues with room for the reserved bandwidth bw are considered; with none
+ * left, linking the process to the one returned fails.
+ */
+static struct proc_rq *select_process_rq(int tgid,
+                                         u64 bw,
+                                         const unsigned int *placed_load,
+                                         const unsigned int *placed_members)
+{
+    unsigned int load, best_load = UINT_MAX;
+    unsigned int members = 0, best_members = UINT_MAX;
+    struct proc_rq *rq, *best = NULL;
+    struct proc_gang *gang;
+    int cpu;
+
+    spin_lock(&table_lock);
+    gang = tgid ? find_gang(tgid) : NULL;
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        if (!rq_bw_fits(rq, 0, bw))
+            continue;
+        load = READ_ONCE(rq->nr_queued) + (READ_ONCE(rq->running) ? 1 : 0);
+        if (gang)
+            members = gang_members_on(gang, rq);
+        if (placed_load) {
+            load += placed_load[cpu];
+            members += placed_members[cpu];
+        }
+        if (members < best_members ||
+            (members == best_members && load < best_load)) {
+            best = rq;
+            best_load = load;
+            best_members = members;
+        }
+    }
+    spin_unlock(&table_lock);
+    return best ? best : per_cpu_ptr(&proc_rqs, cpumask_first(&plugin_cpus));
+}
+
+/* move the next waiting process of the busiest run queue to a drained one,
+ * provided this leaves the busiest one at least as loaded. Nothing moves
+ * between run queues still being switched to different policies, no thread
+ * joins a member of its gang and no reservation goes to a run queue without
+ * room for it.
+ */
+static void steal_process(struct proc_rq *rq)
+{
+    struct proc_rq *busiest = NULL, *other;
+    unsigned int load, nr, max_queued = 0;
+    struct proc *node = NULL;
+    bool stay = false;
+    u64 bw;
+    int cpu;
+
+    for_each_cpu (cpu, &plugin_cpus) {
+        other = per_cpu_ptr(&proc_rqs, cpu);
+        nr = READ_ONCE(other->nr_queued);
+        if (other != rq && nr > max_queued) {
+            busiest = other;
+            max_queued = nr;
+        }
+    }
+    load = READ_ONCE(rq->nr_queued) + (READ_ONCE(rq->running) ? 1 : 0);
+    if (!busiest || max_queued <= load)
+        return;
+
+    double_lock_rq(rq, busiest);
+    load = rq->nr_queued + (rq->running ? 1 : 0);
+    if (busiest->nr_queued > load && busiest->policy == rq->policy) {
+        node = policy_pick_next(busiest);
+        /* Queued processes rule out an empty pick, see pick_next */
+        if (WARN_ON_ONCE(!node)) {
+            double_unlock_rq(rq, busiest);
+            return;
+        }
+        /* A thread does not join a member of its gang on the same CPU, and
+         * a reservation moves along with its process
+         */
+        bw = reservation_bw(node->se.dl_runtime, node->se.dl_period);
+        if (node->gang || bw) {
+            spin_lock(&table_lock);
+            if (node->gang)
+                stay = gang_members_on(node->gang, rq);
+            if (!stay && bw) {
+                stay = reserve_bw(rq, 0, bw);
+                if (!stay)
+                    reserve_bw(busiest, bw, 0);
+            }
+            spin_unlock(&table_lock);
+        }
+    }
+    if (node && !stay) {
+        policy_dequeue(busiest, node);
+        policy_enqueue(rq, node);
+        if (node->state == S_TERMINATED) {
+            busiest->nr_terminated--;
+            rq->nr_terminated++;
+        }
+        WRITE_ONCE(node->rq, rq);
+        list_move_tail(&node->rq_list, &rq->members);
+        state_publish_task(node);
+        state_publish_rq(rq, false, false);
+        state_publish_rq(busiest, false, false);
+        plugin_debug("Process %d stolen by CPU %d from CPU %d\n",
+                     node->pid, rq->cpu, busiest->cpu);
+        plugin_event(EV_MIGRATE, node->pid, busiest->cpu);
+    }
+    double_unlock_rq(rq, busiest);
+}
+
+/* Whether the writer registering a task may change its scheduling, the
+ * check setpriority() makes: the backends act on the task without further
+ * checks afterwards.
+ */
+static bool may_schedule_task(struct task_struct *task)
+{
+    const struct cred *cred = current_cred(), *tcred;
+    bool ret;
+
+    rcu_read_lock();
+    tcred = __task_cred(task);
+    ret = uid_eq(tcred->uid, cred->euid) || uid_eq(tcred->euid, cred->euid) ||
+          ns_capable(tcred->user_ns, CAP_SYS_NICE);
+    rcu_read_unlock();
+    return ret;
+}
+
+/* save the affinity of a task being registered, to be given back once it
+ * is removed
+ */
+static void save_task_affinity(struct proc *node, struct task_struct *task)
+{
+    unsigned long flags;
+
+    node->cpus_allowed = kmalloc(cpumask_size(), GFP_KERNEL);
+    if (!node->cpus_allowed)
+        return;
+    raw_spin_lock_irqsave(&task->pi_lock, flags);
+    cpumask_copy(node->cpus_allowed, &task->cpus_mask);
+    raw_spin_unlock_irqrestore(&task->pi_lock, flags);
+}
+
+/* restrict a task to a set of CPUs */
+static void set_task_affinity(struct pid *pid, const struct cpumask *mask)
+{
+    struct task_struct *task;
+
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench_running)
+        return;
+#endif
+    task = get_pid_task(pid, PIDTYPE_PID);
+    if (!task)
+        return;
+
+    set_cpus_allowed_ptr(task, mask);
+    put_task_struct(task);
+}
+
+/* give a removed task the affinity saved at its registration back and free
+ * it, all CPUs if none could be saved
+ */
+static void restore_task_affinity(struct pid *pid, struct cpumask *saved)
+{
+    set_task_affinity(pid, saved ? saved : cpu_possible_mask);
+    kfree(saved);
+}
+
+/* CPUs owning a run queue, each of them needs its own scheduler tick */
+const struct cpumask *process_queue_cpumask(void)
+{
+    return &plugin_cpus;
+}
+
+/* install the scheduler callback run when the running process of a CPU
+ * exits or blocks, NULL removes it again and waits for the callers still
+ * inside
+ */
+void process_queue_set_resched(void (*resched)(int cpu))
+{
+    rcu_assign_pointer(resched_hook, resched);
+    if (!resched)
+        synchronize_rcu();
+}
+
+/* install the scheduler callback run when a process is queued on a CPU,
+ * NULL removes it again and waits for the callers still inside
+ */
+void process_queue_set_kick(void (*kick)(int cpu))
+{
+    rcu_assign_pointer(kick_hook, kick);
+    if (!kick)
+        synchronize_rcu();
+}
+
+/* current load of the run queue of a CPU */
+void process_queue_load(int cpu, struct sched_plugin_load *load)
+{
+    struct proc_rq *rq;
+
+    memset(load, 0, sizeof(*load));
+    if (!cpumask_test_cpu(cpu, &plugin_cpus))
+        return;
+    rq = per_cpu_ptr(&proc_rqs, cpu);
+
+    spin_lock(&rq->lock);
+    load->nr_running = rq->nr_queued + (rq->running ? 1 : 0);
+    load->weight = rq->load_weight;
+    if (rq->running) {
+        load->curr_weight = rq->running->se.weight;
+        load->weight += load->curr_weight;
+    }
+    load->picked = rq->last_picked;
+    load->wait_ns = rq->last_wait_ns;
+    spin_unlock(&rq->lock);
+}
+
+/* Whether a tick of a CPU could switch processes: some process waits in its
+ * run queue or could be stolen from another one. Without, the tick may stop
+ * until the kick hook is called.
+ */
+bool process_queue_need_tick(int cpu)
+{
+    struct proc_rq *rq = per_cpu_ptr(&proc_rqs, cpu), *other;
+    unsigned int load;
+    int i;
+
+    if (READ_ONCE(rq->nr_queued))
+        return true;
+    load = READ_ONCE(rq->running) ? 1 : 0;
+    for_each_cpu (i, &plugin_cpus) {
+        other = per_cpu_ptr(&proc_rqs, i);
+        if (other != rq && READ_ONCE(other->nr_queued) > load)
+            return true;
+    }
+    return false;
+}
+
+/* unlink a registered task as soon as it exits. This runs in the exiting
+ * task with preemption disabled, after PF_EXITING has been set.
+ */
+static void process_exit_probe(void *data, struct task_struct *p)
+{
+    void (*resched)(int cpu);
+    struct proc_rq *rq;
+    struct proc *node;
+    bool was_running;
+    int cpu;
+
+    /* Pairs with the barrier in add_process_to_queue */
+    smp_mb();
+    rq = lock_process_rq(task_pid_nr(p), &node);
+    if (!rq)
+        return;
+    if (node->tpid != task_pid(p)) {
+        spin_unlock(&rq->lock);
+        return;
+    }
+
+    plugin_info("Removing the exited Process %d from the Process Queue...\n",
+                node->pid);
+    was_running = node == rq->running;
+    cpu = rq->cpu;
+    unlink_process(rq, node);
+    spin_unlock(&rq->lock);
+    plugin_event(EV_EXIT, task_pid_nr(p), cpu);
+
+    if (!was_running)
+        return;
+    rcu_read_lock();
+    resched = rcu_dereference(resched_hook);
+    if (resched)
+        resched(cpu);
+    rcu_read_unlock();
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 16, 0)
+static void process_exit_tp(void *data, struct task_struct *p, bool group_dead)
+{
+    process_exit_probe(data, p);
+}
+#else
+static void process_exit_tp(void *data, struct task_struct *p)
+{
+    process_exit_probe(data, p);
+}
+#endif
+
+/* The running process of a CPU blocked, hand its CPU on right away. This
+ * runs in hard interrupt context, raised by the switch probe.
+ */
+static void block_work_fn(struct irq_work *work)
+{
+    struct proc_rq *rq = container_of(work, struct proc_rq, block_work);
+    void (*resched)(int cpu);
+
+    rcu_read_lock();
+    resched = rcu_dereference(resched_hook);
+    if (resched)
+        resched(rq->cpu);
+    rcu_read_unlock();
+}
+
+/* Notice the running process of a run queue going to sleep. This runs inside
+ * the scheduler with its run queue lock held, so it takes no lock of its own
+ * and defers the switch to an irq_work.
+ */
+static void process_switch_probe(bool preempt,
+                                 struct task_struct *prev,
+                                 unsigned int prev_state)
+{
+    struct proc_rq *rq = this_cpu_ptr(&proc_rqs);
+
+    if (preempt || !(prev_state & TASK_ASLEEP))
+        return;
+    if (task_pid(prev) == READ_ONCE(rq->running_tpid))
+        irq_work_queue(&rq->block_work);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+static void process_switch_tp(void *data,
+                              bool preempt,
+                              struct task_struct *prev,
+                              struct task_struct *next,
+                              unsigned int prev_state)
+{
+    process_switch_probe(preempt, prev, prev_state);
+}
+#else
+static void process_switch_tp(void *data,
+                              bool preempt,
+                              struct task_struct *prev,
+                              struct task_struct *next)
+{
+    process_switch_probe(preempt, prev, task_run_state(prev));
+}
+#endif
+
+static void find_tracepoints(struct tracepoint *tp, void *priv)
+{
+    if (!strcmp(tp->name, "sched_process_exit"))
+        exit_tracepoint = tp;
+    else if (!strcmp(tp->name, "sched_switch"))
+        switch_tracepoint = tp;
+}
+
+/* unhook the probes and wait for the ones still running and the switches
+ * they raised
+ */
+static void unregister_probes(void)
+{
+    int cpu;
+
+    tracepoint_probe_unregister(switch_tracepoint, process_switch_tp, NULL);
+    tracepoint_probe_unregister(exit_tracepoint, process_exit_tp, NULL);
+    tracepoint_synchronize_unregister();
+    for_each_possible_cpu (cpu)
+        irq_work_sync(&per_cpu_ptr(&proc_rqs, cpu)->block_work);
+}
+
+static int tunable_show(struct seq_file *m, void *v)
+{
+    const struct sched_plugin_tunable *tunable = m->private;
+
+    return tunable->show(m);
+}
+
+static int tunable_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tunable_show, pde_data(inode));
+}
+
+static ssize_t tunable_write(struct file *file,
+                             const char __user *ubuf,
+                             size_t count,
+                             loff_t *ppos)
+{
+    const struct sched_plugin_tunable *tunable =
+        ((struct seq_file *) file->private_data)->private;
+    char buf[32];
+    int ret;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    ret = tunable->store(strim(buf));
+    return ret ? ret : count;
+}
+
+/* File operations shared by every /proc/sched_plugin tunable */
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops tunable_fops = {
+    .proc_open = tunable_open,
+    .proc_read = seq_read,
+    .proc_write = tunable_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+#else
+static const struct file_operations tunable_fops = {
+    .owner = THIS_MODULE,
+    .open = tunable_open,
+    .read = seq_read,
+    .write = tunable_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+#endif
+
+/* expose a runtime tunable as /proc/sched_plugin/<name> */
+int sched_plugin_add_tunable(const struct sched_plugin_tunable *tunable)
+{
+    if (!proc_create_data(tunable->name, 0644, sched_plugin_dir, &tunable_fops,
+                          (void *) tunable)) {
+        printk(KERN_ALERT
+               "Error: Could not initialize /proc/sched_plugin/%s\n",
+               tunable->name);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void sched_plugin_remove_tunable(const struct sched_plugin_tunable *tunable)
+{
+    remove_proc_entry(tunable->name, sched_plugin_dir);
+}
+
+static int max_tasks_show(struct seq_file *m)
+{
+    seq_printf(m, "%u\n", READ_ONCE(max_tasks));
+    return 0;
+}
+
+/* Lowering the bound below the registered count only stops new
+ * registrations, no queued process is dropped.
+ */
+static int max_tasks_store(const char *buf)
+{
+    unsigned int val;
+    int ret = kstrtouint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    WRITE_ONCE(max_tasks, val);
+    return 0;
+}
+
+static int dl_bound_show(struct seq_file *m)
+{
+    seq_printf(m, "%u\n", READ_ONCE(dl_bound));
+    return 0;
+}
+
+/* Lowering the bound below the reserved bandwidth only stops new
+ * reservations, no process loses its own.
+ */
+static int dl_bound_store(const char *buf)
+{
+    unsigned int val;
+    int ret = kstrtouint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    if (val > 100)
+        return -EINVAL;
+    WRITE_ONCE(dl_bound, val);
+    return 0;
+}
+
+static int gang_show(struct seq_file *m)
+{
+    seq_printf(m, "%d\n", READ_ONCE(gang_sched));
+    return 0;
+}
+
+/* Gangs are still formed while disabled, only no longer co-scheduled */
+static int gang_store(const char *buf)
+{
+    bool val;
+    int ret = kstrtobool(buf, &val);
+
+    if (ret)
+        return ret;
+    WRITE_ONCE(gang_sched, val);
+    return 0;
+}
+
+static int log_level_show(struct seq_file *m)
+{
+    seq_printf(m, "%d\n", READ_ONCE(sched_plugin_log_level));
+    return 0;
+}
+
+/* switch the logging level and the static keys following it */
+static void set_log_level(int level)
+{
+    mutex_lock(&log_mutex);
+    WRITE_ONCE(sched_plugin_log_level, level);
+    if (level >= SCHED_LOG_INFO)
+        static_branch_enable(&sched_plugin_info_key);
+    else
+        static_branch_disable(&sched_plugin_info_key);
+    if (level >= SCHED_LOG_DEBUG)
+        static_branch_enable(&sched_plugin_debug_key);
+    else
+        static_branch_disable(&sched_plugin_debug_key);
+    mutex_unlock(&log_mutex);
+}
+
+static int log_level_store(const char *buf)
+{
+    int val, ret = kstrtoint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    if (val < SCHED_LOG_ERR || val > SCHED_LOG_DEBUG)
+        return -EINVAL;
+    set_log_level(val);
+    return 0;
+}
+
+/* record an event in the ring of the current CPU */
+void __sched_plugin_event(enum sched_plugin_event_type type, int pid, int arg)
+{
+    struct plugin_event *ev;
+    struct event_ring *ring;
+    unsigned long pos;
+
+    preempt_disable();
+    ring = this_cpu_ptr(&event_rings);
+    if (ring->events) {
+        pos = this_cpu_inc_return(event_rings.head) - 1;
+        ev = &ring->events[pos & (event_ring_size - 1)];
+        WRITE_ONCE(ev->seq, 0);
+        smp_wmb();
+        ev->ts = ktime_get_ns();
+        ev->type = type;
+        ev->pid = pid;
+        ev->arg = arg;
+        smp_store_release(&ev->seq, pos + 1);
+    }
+    preempt_enable();
+}
+
+/* Allocate the rings of all possible CPUs, log_mutex must be held. They
+ * stay allocated until the module is unloaded, a CPU whose ring could not
+ * be allocated records nothing.
+ */
+static int alloc_event_rings(void)
+{
+    struct event_ring *ring;
+    int cpu;
+
+    if (events_allocated)
+        return 0;
+    if (!event_ring_size || event_ring_size > (1U << 20))
+        return -EINVAL;
+    event_ring_size = roundup_pow_of_two(event_ring_size);
+    for_each_possible_cpu (cpu) {
+        ring = per_cpu_ptr(&event_rings, cpu);
+        ring->head = 0;
+        ring->cpu = cpu;
+        ring->events = kvzalloc_node(
+            array_size(event_ring_size, sizeof(*ring->events)), GFP_KERNEL,
+            cpu_to_node(cpu));
+    }
+    events_allocated = true;
+    return 0;
+}
+
+static void free_event_rings(void)
+{
+    int cpu;
+
+    for_each_possible_cpu (cpu) {
+        kvfree(per_cpu_ptr(&event_rings, cpu)->events);
+        per_cpu_ptr(&event_rings, cpu)->events = NULL;
+    }
+}
+
+static int events_show(struct seq_file *m)
+{
+    seq_printf(m, "%d\n", plugin_event_enabled() ? 1 : 0);
+    return 0;
+}
+
+/* Disabling keeps the events recorded so far readable */
+static int events_store(const char *buf)
+{
+    bool val;
+    int ret = kstrtobool(buf, &val);
+
+    if (ret)
+        return ret;
+    mutex_lock(&log_mutex);
+    if (val) {
+        ret = alloc_event_rings();
+        if (!ret)
+            static_branch_enable(&sched_plugin_event_key);
+    } else {
+        static_branch_disable(&sched_plugin_event_key);
+    }
+    mutex_unlock(&log_mutex);
+    return ret;
+}
+
+/* The event file shows the ring of one CPU per iteration step */
+static void *event_seq_start(struct seq_file *m, loff_t *pos)
+{
+    int cpu = *pos ? cpumask_next(*pos - 1, cpu_possible_mask)
+                   : cpumask_first(cpu_possible_mask);
+
+    if (cpu >= nr_cpu_ids)
+        return NULL;
+    *pos = cpu;
+    return per_cpu_ptr(&event_rings, cpu);
+}
+
+static void *event_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    ++*pos;
+    return event_seq_start(m, pos);
+}
+
+static void event_seq_stop(struct seq_file *m, void *v) {}
+
+/* Print the events of a ring from the oldest on. An event overwritten
+ * while being copied is skipped.
+ */
+static int event_seq_show(struct seq_file *m, void *v)
+{
+    struct event_ring *ring = v;
+    struct plugin_event ev, *slot;
+    unsigned long pos, head;
+    u32 nsec;
+    u64 sec;
+
+    if (!ring->events)
+        return 0;
+    head = READ_ONCE(ring->head);
+    pos = head > event_ring_size ? head - event_ring_size : 0;
+    for (; pos < head; pos++) {
+        slot = &ring->events[pos & (event_ring_size - 1)];
+        if (smp_load_acquire(&slot->seq) != pos + 1)
+            continue;
+        ev = *slot;
+        smp_rmb();
+        if (READ_ONCE(slot->seq) != pos + 1 || ev.type >= EV_NR_TYPES)
+            continue;
+        sec = div_u64_rem(ev.ts, NSEC_PER_SEC, &nsec);
+        seq_printf(m, "%llu.%06u cpu=%d %s pid=%d arg=%d\n", sec,
+                   nsec / NSEC_PER_USEC, ring->cpu, event_names[ev.type],
+                   ev.pid, ev.arg);
+    }
+    return 0;
+}
+
+static const struct seq_operations event_seq_ops = {
+    .start = event_seq_start,
+    .next = event_seq_next,
+    .stop = event_seq_stop,
+    .show = event_seq_show,
+};
+
+static int event_open(struct inode *inode, struct file *file)
+{
+    return seq_open(file, &event_seq_ops);
+}
+
+/* debugfs file of the event rings, debugfs takes file_operations only */
+static const struct file_operations event_fops = {
+    .owner = THIS_MODULE,
+    .open = event_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = seq_release,
+};
+
+static int policy_show(struct seq_file *m)
+{
+    struct sched_plugin_policy *policy;
+
+    /* List the registered policies, the active one in brackets */
+    mutex_lock(&policy_mutex);
+    list_for_each_entry (policy, &policies, list)
+        seq_printf(m, policy == active_policy ? "[%s] " : "%s ",
+                   policy->name);
+    mutex_unlock(&policy_mutex);
+    seq_putc(m, '\n');
+    return 0;
+}
+
+/* The queued processes are handed over to the new policy, none is dropped */
+static int policy_store(const char *buf)
+{
+    struct sched_plugin_policy *policy;
+    int ret = -EINVAL;
+
+    mutex_lock(&policy_mutex);
+    policy = find_policy(buf);
+    if (policy)
+        ret = switch_policy(policy);
+    mutex_unlock(&policy_mutex);
+    return ret;
+}
+
+/* The suspension backend belongs to the active policy */
+static int suspend_show(struct seq_file *m)
+{
+    int i, cur;
+
+    mutex_lock(&policy_mutex);
+    cur = active_policy->suspend;
+    mutex_unlock(&policy_mutex);
+
+    /* List the available backends, the active one in brackets */
+    for (i = 0; i < ARRAY_SIZE(suspend_backends); i++)
+        seq_printf(m, i == cur ? "[%s] " : "%s ", suspend_backends[i].name);
+    seq_putc(m, '\n');
+    return 0;
+}
+
+/* Tasks suspended by the previous backend are resumed by it once more and
+ * only then switch over, no queued process is dropped.
+ */
+static int suspend_store(const char *buf)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(suspend_backends); i++) {
+        if (!strcmp(buf, suspend_backends[i].name)) {
+            mutex_lock(&policy_mutex);
+            WRITE_ONCE(active_policy->suspend, i);
+            mutex_unlock(&policy_mutex);
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static const struct sched_plugin_tunable queue_tunables[] = {
+    {.name = "max_tasks", .show = max_tasks_show, .store = max_tasks_store},
+    {.name = "log_level", .show = log_level_show, .store = log_level_store},
+    {.name = "policy", .show = policy_show, .store = policy_store},
+    {.name = "suspend", .show = suspend_show, .store = suspend_store},
+    {.name = "dl_bound", .show = dl_bound_show, .store = dl_bound_store},
+    {.name = "gang", .show = gang_show, .store = gang_store},
+    {.name = "events", .show = events_show, .store = events_store},
+};
+
+/* initialize a process queue */
+int init_process_queue(void)
+{
+    struct proc_rq *rq;
+    int cpu, ret;
+
+    printk(KERN_INFO "Initializing the Process Queue...\n");
+
+    /* Generate the head of the list and initializing an empty run queue for
+     * every CPU.
+     */
+    INIT_LIST_HEAD(&top.list);
+    ret = rhashtable_init(&proc_table, &proc_params);
+    if (ret)
+        return ret;
+    active_policy = &rr_policy;
+    for_each_possible_cpu (cpu) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        spin_lock_init(&rq->lock);
+        rq->policy = &rr_policy;
+        rq->priv = rr_alloc_rq(cpu);
+        rq->next_priv = NULL;
+        rq->running = NULL;
+        rq->running_tpid = NULL;
+        init_irq_work(&rq->block_work, block_work_fn);
+        rq->nr_queued = 0;
+        rq->load_weight = 0;
+        rq->last_wait_ns = 0;
+        rq->last_picked = false;
+        rq->gang_next = 0;
+        rq->yield_pid = 0;
+        rq->last_rotation = 0;
+        rq->nr_terminated = 0;
+        rq->dl_bw = 0;
+        INIT_LIST_HEAD(&rq->members);
+        rq->cpu = cpu;
+    }
+    return 0;
+}
+
+/* release a process queue */
+int release_process_queue(void)
+{
+    const struct suspend_backend *backend;
+    struct cpumask *cpus;
+    struct proc_rq *rq;
+    struct proc *node;
+    struct pid *tpid;
+    int cpu, nice;
+
+    printk(KERN_INFO "Releasing Process Queue...\n");
+
+    /* Iterate over the run queues and remove the nodes pertaining to the
+     * process information one by one. The backends may sleep, so each task
+     * is released once the lock is dropped.
+     */
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        for (;;) {
+            spin_lock(&rq->lock);
+            node = policy_pick_next(rq);
+            if (!node)
+                node = rq->running;
+            if (!node) {
+                spin_unlock(&rq->lock);
+                break;
+            }
+            tpid = get_pid(node->tpid);
+            backend = node->suspend;
+            nice = node->nice;
+            cpus = node->cpus_allowed;
+            node->cpus_allowed = NULL;
+            unlink_process(rq, node);
+            spin_unlock(&rq->lock);
+
+            task_release(tpid, backend, nice);
+            restore_task_affinity(tpid, cpus);
+            put_pid(tpid);
+        }
+    }
+    /* success */
+    return 0;
+}
+
+/* reject attributes out of their range before anything is changed */
+static int check_process_attr(const struct sched_plugin_attr *attr)
+{
+    if ((attr->set & SCHED_ATTR_WEIGHT) &&
+        (attr->weight < SCHED_PLUGIN_WEIGHT_MIN ||
+         attr->weight > SCHED_PLUGIN_WEIGHT_MAX))
+        return -EINVAL;
+    if ((attr->set & SCHED_ATTR_PRIO) &&
+        (attr->prio < 0 || attr->prio >= SCHED_PLUGIN_NR_PRIO))
+        return -EINVAL;
+    if ((attr->set & SCHED_ATTR_TICKETS) &&
+        (attr->tickets < SCHED_PLUGIN_TICKETS_MIN ||
+         attr->tickets > SCHED_PLUGIN_TICKETS_MAX))
+        return -EINVAL;
+    if (attr->set & SCHED_ATTR_RESERVATION) {
+        u64 deadline = attr->set & SCHED_ATTR_DEADLINE ? attr->deadline
+                                                       : attr->period;
+
+        /* Runtime and period come together, runtime <= deadline <= period */
+        if (!(attr->set & SCHED_ATTR_RUNTIME) ||
+            !(attr->set & SCHED_ATTR_PERIOD))
+            return -EINVAL;
+        if (!attr->period)
+            return attr->runtime ? -EINVAL : 0;
+        if (!attr->runtime || attr->runtime > deadline ||
+            deadline > attr->period)
+            return -EINVAL;
+    }
+    return 0;
+}
+
+/* apply attributes to a node, its run queue lock must be held when it is
+ * linked. A waiting process is queued again so that its policy sees the new
+ * values, the running one picks them up on its next tick.
+ */
+static void apply_process_attr(struct proc_rq *rq,
+                               struct proc *node,
+                               const struct sched_plugin_attr *attr)
+{
+    bool queued = rq && node != rq->running;
+
+    if (queued)
+        policy_dequeue(rq, node);
+    if (attr->set & SCHED_ATTR_WEIGHT)
+        node->se.weight = attr->weight;
+    if (attr->set & SCHED_ATTR_PRIO)
+        node->se.prio = attr->prio;
+    if (attr->set & SCHED_ATTR_TICKETS)
+        node->se.tickets = attr->tickets;
+    if (attr->set & SCHED_ATTR_RESERVATION) {
+        /* A new reservation starts with a new period */
+        node->se.dl_runtime = attr->runtime;
+        node->se.dl_period = attr->period;
+        node->se.dl_deadline = attr->set & SCHED_ATTR_DEADLINE
+                                   ? attr->deadline
+                                   : attr->period;
+        node->se.deadline = 0;
+        node->se.dl_release = 0;
+        node->se.budget = 0;
+        node->se.dl_throttled = false;
+    }
+    if (queued)
+        policy_enqueue(rq, node);
+}
+
+/* change the attributes of a registered process */
+static int set_process_attr(int pid, const struct sched_plugin_attr *attr)
+{
+    struct proc_rq *rq;
+    struct proc *node;
+    int ret;
+
+    rq = lock_process_rq(pid, &node);
+    if (!rq)
+        return -ESRCH;
+    if (attr->set & SCHED_ATTR_RESERVATION) {
+        spin_lock(&table_lock);
+        ret = reserve_bw(
+            rq, reservation_bw(node->se.dl_runtime, node->se.dl_period),
+            reservation_bw(attr->runtime, attr->period));
+        spin_unlock(&table_lock);
+        if (ret) {
+            spin_unlock(&rq->lock);
+            return ret;
+        }
+    }
+    apply_process_attr(rq, node, attr);
+    spin_unlock(&rq->lock);
+
+    plugin_info("Attributes of Process %d updated\n", pid);
+    return 0;
+}
+
+/* look up two registered PIDs and lock the run queues owning them, either
+ * nodes may move to another run queue until those locks are taken
+ */
+static int lock_process_rq_pair(int pid_a,
+                                int pid_b,
+                                struct proc **pa,
+                                struct proc **pb)
+{
+    struct proc_rq *rq_a, *rq_b;
+    struct proc *a, *b;
+
+    rcu_read_lock();
+    for (;;) {
+        a = find_process_in_queue(pid_a);
+        b = find_process_in_queue(pid_b);
+        if (!a || !b) {
+            rcu_read_unlock();
+            return -ESRCH;
+        }
+        rq_a = READ_ONCE(a->rq);
+        rq_b = READ_ONCE(b->rq);
+        if (rq_a == rq_b)
+            spin_lock(&rq_a->lock);
+        else
+            double_lock_rq(rq_a, rq_b);
+        if (a->rq == rq_a && b->rq == rq_b && a->linked && b->linked)
+            break;
+        spin_unlock(&rq_a->lock);
+        if (rq_a != rq_b)
+            spin_unlock(&rq_b->lock);
+    }
+    rcu_read_unlock();
+
+    *pa = a;
+    *pb = b;
+    return 0;
+}
+
+/* move lottery tickets from one registered process to another, e.g. from a
+ * client to the server working on its request. The giver keeps at least
+ * one ticket.
+ */
+int transfer_process_tickets(int from, int to, unsigned int tickets)
+{
+    struct sched_plugin_attr attr = {.set = SCHED_ATTR_TICKETS};
+    struct proc *giver, *taker;
+    int ret;
+
+    if (from == to)
+        return -EINVAL;
+    ret = lock_process_rq_pair(from, to, &giver, &taker);
+    if (ret)
+        return ret;
+
+    if (tickets >= giver->se.tickets ||
+        taker->se.tickets + tickets > SCHED_PLUGIN_TICKETS_MAX) {
+        ret = -EINVAL;
+    } else {
+        attr.tickets = giver->se.tickets - tickets;
+        apply_process_attr(giver->rq, giver, &attr);
+        attr.tickets = taker->se.tickets + tickets;
+        apply_process_attr(taker->rq, taker, &attr);
+    }
+
+    spin_unlock(&giver->rq->lock);
+    if (giver->rq != taker->rq)
+        spin_unlock(&taker->rq->lock);
+    if (!ret)
+        plugin_info("%u tickets transferred from Process %d to Process %d\n",
+                    tickets, from, to);
+    return ret;
+}
+
+/* Backend suspending a task about to be queued, the one of the active
+ * policy. The task is suspended before its node is linked, since a rotation
+ * may pick and resume it right afterwards.
+ */
+static const struct suspend_backend *queue_backend(void)
+{
+    const struct suspend_backend *backend;
+
+    mutex_lock(&policy_mutex);
+    backend = &suspend_backends[active_policy->suspend];
+    mutex_unlock(&policy_mutex);
+    return backend;
+}
+
+/* whether a PID is registered already */
+static bool process_registered(int pid)
+{
+    bool ret;
+
+    rcu_read_lock();
+    ret = find_process_in_queue(pid) != NULL;
+    rcu_read_unlock();
+    return ret;
+}
+
+/* Resume a task suspended ahead of a registration which failed, unless the
+ * PID was registered by another writer meanwhile and waits in its run queue
+ * suspended with the same backend.
+ */
+static void resume_unlinked(int pid,
+                            struct pid *tpid,
+                            const struct suspend_backend *backend,
+                            int nice)
+{
+    struct proc_rq *rq;
+    struct proc *node;
+    bool waiting = false;
+
+    rq = lock_process_rq(pid, &node);
+    if (rq) {
+        waiting = node->tpid == tpid && node != rq->running &&
+                  node->suspend == backend;
+        spin_unlock(&rq->lock);
+    }
+    if (!waiting)
+        task_status_change(tpid, backend, nice, S_RUNNING);
+}
+
+/* whether the task of a PID is gone or exiting */
+static bool task_exiting(struct pid *pid)
+{
+    struct task_struct *task = get_pid_task(pid, PIDTYPE_PID);
+    bool ret = !task || (task->flags & PF_EXITING);
+
+    if (task)
+        put_task_struct(task);
+    return ret;
+}
+
+/* add a process into a queue with the given attributes, or update the
+ * attributes of a process registered already. attr may be NULL.
+ */
+int add_process_to_queue(int pid, const struct sched_plugin_attr *attr)
+{
+    const struct suspend_backend *backend;
+    void (*kick)(int cpu);
+    struct task_struct *task;
+    struct proc_rq *rq;
+    struct pid *tpid;
+    int ret, nice;
+
+    /* Allocating space for the newly registered process, its state is set
+     * to waiting.
+     */
+    struct proc *new_process;
+
+    if (attr) {
+        ret = check_process_attr(attr);
+        if (ret)
+            return ret;
+    }
+
+    new_process = alloc_process(pid);
+
+    /* Check if the allocation was successful or not */
+    if (!new_process) {
+        printk(KERN_ALERT
+               "Process Queue ERROR: allocation failed from "
+               "add_process_to_queue function.");
+        /* Add process to queue error */
+        return -ENOMEM;
+    }
+
+    /* Only an existing task the writer may change can be registered */
+    task = get_pid_task(new_process->tpid, PIDTYPE_PID);
+    if (!task) {
+        free_process(new_process);
+        return -ESRCH;
+    }
+    if (!may_schedule_task(task)) {
+        put_task_struct(task);
+        free_process(new_process);
+        return -EPERM;
+    }
+    new_process->nice = task_nice(task);
+    new_process->tgid = task_tgid_nr(task);
+    save_task_affinity(new_process, task);
+    put_task_struct(task);
+    if (attr)
+        apply_process_attr(NULL, new_process, attr);
+
+    /* A PID is registered at most once, registering it again only updates
+     * its attributes. It is neither suspended nor queued a second time.
+     */
+    if (process_registered(pid)) {
+        free_process(new_process);
+        return attr ? set_process_attr(pid, attr) : 0;
+    }
+
+    /* The node may be unlinked by the exit probe as soon as it is linked */
+    tpid = get_pid(new_process->tpid);
+    nice = new_process->nice;
+    backend = queue_backend();
+    new_process->suspend = backend;
+    if (task_status_change(tpid, backend, nice, S_WAITING) == TS_TERMINATED) {
+        free_process(new_process);
+        put_pid(tpid);
+        return -ESRCH;
+    }
+
+    /* Entry into the mutually exclusive block is granted by the lock of the
+     * least loaded run queue.
+     */
+    rq = select_process_rq(new_process->tgid,
+                           reservation_bw(new_process->se.dl_runtime,
+                                          new_process->se.dl_period),
+                           NULL, NULL);
+    spin_lock(&rq->lock);
+    ret = link_process(rq, new_process);
+    spin_unlock(&rq->lock);
+
+    /* Another writer may have registered the PID meanwhile */
+    if (ret) {
+        free_process(new_process);
+        resume_unlinked(pid, tpid, backend, nice);
+        put_pid(tpid);
+        if (ret == -EEXIST && attr)
+            return set_process_attr(pid, attr);
+        if (ret == -ENOSPC)
+            printk(KERN_ALERT
+                   "Process Queue ERROR: max_tasks reached, Process %d is not "
+                   "registered\n",
+                   pid);
+        if (ret == -EBUSY)
+            printk(KERN_ALERT
+                   "Process Queue ERROR: dl_bound exceeded, Process %d is not "
+                   "registered\n",
+                   pid);
+        return ret == -EEXIST ? 0 : ret;
+    }
+
+    /* A task exiting before the exit probe could see the new node is removed
+     * here instead. Pairs with the barrier in process_exit_probe.
+     */
+    smp_mb();
+    ret = task_exiting(tpid);
+    put_pid(tpid);
+    if (ret) {
+        remove_process_from_queue(pid);
+        return -ESRCH;
+    }
+
+    plugin_info("Adding the given Process %d to the Process Queue of CPU "
+                "%d...\n",
+                pid, rq->cpu);
+    plugin_event(EV_REGISTER, pid, rq->cpu);
+
+    /* The tick of the CPU may have stopped while it had nothing to switch */
+    rcu_read_lock();
+    kick = rcu_dereference(kick_hook);
+    if (kick)
+        kick(rq->cpu);
+    rcu_read_unlock();
+    /* success */
+    return 0;
+}
+
+/* One process of a registration batch */
+struct batch_entry {
+    struct proc *node;                     /* Node to link, NULL once done */
+    struct pid *tpid;                      /* Reference held across the link */
+    const struct suspend_backend *backend; /* Backend it was suspended with */
+    int nice;                              /* Nice level of registration */
+    int cpu;                               /* CPU of its run queue */
+    int ret;                               /* Outcome of the registration */
+};
+
+/* Spread the valid entries of a batch over the run queues as
+ * select_process_rq places single processes, counting the entries placed
+ * before each one. The threads of a thread group are placed one after the
+ * other, so that its gang goes to separate CPUs as far as there are enough.
+ */
+static void spread_batch(struct batch_entry *batch, int nr)
+{
+    unsigned int *loads, *members;
+    struct proc *node;
+    struct proc_rq *rq;
+    int tgid, i, j;
+
+    loads = kcalloc(2 * nr_cpu_ids, sizeof(*loads), GFP_KERNEL);
+    if (!loads) {
+        /* Not worth failing over, the run queues balance by stealing */
+        rq = select_process_rq(0, 0, NULL, NULL);
+        for (i = 0; i < nr; i++) {
+            if (batch[i].node)
+                batch[i].node->rq = rq;
+        }
+        return;
+    }
+    members = loads + nr_cpu_ids;
+
+    for (i = 0; i < nr; i++) {
+        if (!batch[i].node || batch[i].node->rq)
+            continue;
+        tgid = batch[i].node->tgid;
+        memset(members, 0, nr_cpu_ids * sizeof(*members));
+        for (j = i; j < nr; j++) {
+            node = batch[j].node;
+            if (!node || node->rq || node->tgid != tgid)
+                continue;
+            rq = select_process_rq(
+                tgid,
+                reservation_bw(node->se.dl_runtime, node->se.dl_period),
+                loads, members);
+            loads[rq->cpu]++;
+            members[rq->cpu]++;
+            node->rq = rq;
+        }
+    }
+    kfree(loads);
+}
+
+/* Register a batch of processes without attributes. The nodes are
+ * allocated up front and linked with a single acquisition of the lock of
+ * every run queue they go to, rather than once per process. Every PID is
+ * registered on its own: one which fails does not stop the others, and one
+ * registered already is left as it is. Returns 0 or the error of the first
+ * PID which could not be registered.
+ */
+int add_processes_to_queue(const int *pids, int nr)
+{
+    const struct suspend_backend *backend;
+    struct batch_entry *batch;
+    struct task_struct *task;
+    void (*kick)(int cpu);
+    cpumask_var_t kicked;
+    struct proc_rq *rq;
+    struct proc *node;
+    int cpu, i, ret = 0;
+
+    if (nr <= 0)
+        return 0;
+    batch = kvcalloc(nr, sizeof(*batch), GFP_KERNEL);
+    if (!batch || !zalloc_cpumask_var(&kicked, GFP_KERNEL)) {
+        kvfree(batch);
+        return -ENOMEM;
+    }
+
+    /* Allocate and check every node and suspend its task before taking any
+     * lock, see add_process_to_queue. A PID registered already is left as it
+     * is.
+     */
+    backend = queue_backend();
+    for (i = 0; i < nr; i++) {
+        if (process_registered(pids[i]))
+            continue;
+        node = alloc_process(pids[i]);
+        if (!node) {
+            batch[i].ret = -ENOMEM;
+            continue;
+        }
+        task = get_pid_task(node->tpid, PIDTYPE_PID);
+        if (!task) {
+            free_process(node);
+            batch[i].ret = -ESRCH;
+            continue;
+        }
+        if (!may_schedule_task(task)) {
+            put_task_struct(task);
+            free_process(node);
+            batch[i].ret = -EPERM;
+            continue;
+        }
+        node->nice = task_nice(task);
+        node->tgid = task_tgid_nr(task);
+        save_task_affinity(node, task);
+        put_task_struct(task);
+        /* The node may be unlinked by the exit probe as soon as it is
+         * linked
+         */
+        node->suspend = backend;
+        batch[i].tpid = get_pid(node->tpid);
+        batch[i].backend = backend;
+        batch[i].nice = node->nice;
+        if (task_status_change(batch[i].tpid, backend, node->nice,
+                               S_WAITING) == TS_TERMINATED) {
+            free_process(node);
+            put_pid(batch[i].tpid);
+            batch[i].tpid = NULL;
+            batch[i].ret = -ESRCH;
+            continue;
+        }
+        batch[i].node = node;
+    }
+
+    spread_batch(batch, nr);
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        spin_lock(&rq->lock);
+        for (i = 0; i < nr; i++) {
+            node = batch[i].node;
+            if (!node || node->rq != rq)
+                continue;
+            batch[i].ret = link_process(rq, node);
+            batch[i].cpu = cpu;
+            if (!batch[i].ret)
+                batch[i].node = NULL;
+        }
+        spin_unlock(&rq->lock);
+    }
+
+    /* Pairs with the barrier in process_exit_probe, see
+     * add_process_to_queue
+     */
+    smp_mb();
+    for (i = 0; i < nr; i++) {
+        if (batch[i].node) {
+            /* Not linked, a PID registered already is no error */
+            free_process(batch[i].node);
+            resume_unlinked(pids[i], batch[i].tpid, batch[i].backend,
+                            batch[i].nice);
+            put_pid(batch[i].tpid);
+            if (batch[i].ret == -EEXIST)
+                batch[i].ret = 0;
+            if (batch[i].ret == -ENOSPC || batch[i].ret == -EBUSY)
+                printk(KERN_ALERT
+                       "Process Queue ERROR: Process %d is not registered, "
+                       "error %d\n",
+                       pids[i], batch[i].ret);
+        } else if (batch[i].tpid) {
+            if (task_exiting(batch[i].tpid)) {
+                remove_process_from_queue(pids[i]);
+                batch[i].ret = -ESRCH;
+            } else {
+                cpumask_set_cpu(batch[i].cpu, kicked);
+                plugin_event(EV_REGISTER, pids[i], batch[i].cpu);
+            }
+            put_pid(batch[i].tpid);
+        }
+        if (batch[i].ret && !ret)
+            ret = batch[i].ret;
+    }
+
+    plugin_info("Added a batch of %d Processes to the Process Queue\n", nr);
+
+    /* The ticks of the CPUs may have stopped while they had nothing to
+     * switch
+     */
+    rcu_read_lock();
+    kick = rcu_dereference(kick_hook);
+    if (kick) {
+        for_each_cpu (cpu, kicked)
+            kick(cpu);
+    }
+    rcu_read_unlock();
+
+    free_cpumask_var(kicked);
+    kvfree(batch);
+    return ret;
+}
+
+/* remove a specified process from the queue */
+int remove_process_from_queue(int pid)
+{
+    const struct suspend_backend *backend;
+    struct cpumask *cpus;
+    struct proc_rq *rq;
+    struct proc *node;
+    struct pid *tpid;
+    int nice;
+
+    /* Look up the process with provided PID and remove it */
+    rq = lock_process_rq(pid, &node);
+    if (!rq)
+        return 0;
+
+    plugin_info("Removing the given Process %d from the  Process Queue...\n",
+                pid);
+    plugin_event(EV_REMOVE, pid, rq->cpu);
+    tpid = get_pid(node->tpid);
+    backend = node->suspend;
+    nice = node->nice;
+    cpus = node->cpus_allowed;
+    node->cpus_allowed = NULL;
+    unlink_process(rq, node);
+    spin_unlock(&rq->lock);
+
+    /* The process is not scheduled by the plugin any more */
+    task_release(tpid, backend, nice);
+    restore_task_affinity(tpid, cpus);
+    put_pid(tpid);
+    /* success */
+    return 0;
+}
+
+/* remove all terminated processes from the queue */
+int remove_terminated_processes_from_queue(void)
+{
+    struct proc *node, *next;
+    struct proc_rq *rq;
+    int cpu;
+
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        spin_lock(&rq->lock);
+        /* Iterate over the processes of the run queue and remove all
+         * terminated ones, skipping the walk entirely when nothing has been
+         * marked.
+         */
+        list_for_each_entry_safe (node, next, &rq->members, rq_list) {
+            if (!rq->nr_terminated)
+                break;
+            /* Check if the process is terminated or not */
+            if (node->state == S_TERMINATED) {
+                plugin_info("Removing the terminated Process %d from the "
+                            "Process Queue...\n",
+                            node->pid);
+                unlink_process(rq, node);
+            }
+        }
+        spin_unlock(&rq->lock);
+    }
+    /* success */
+    return 0;
+}
 
-/* Enumeration for Process States */
-enum process_state {
-    S_CREATED = 0,   /* Process in Created State */
-    S_RUNNING = 1,   /* Process in Running State */
-    S_WAITING = 2,   /* Process in Waiting State */
-    S_BLOCKING = 3,  /* Process in Blocked State */
-    S_TERMINATED = 4 /* Process in Terminate State */
+/* Suspension or resumption of a task deferred until the run queue lock is
+ * dropped, since the backends may sleep
+ */
+struct task_op {
+    struct pid *tpid;                      /* Reference to the task */
+    const struct suspend_backend *backend; /* Backend to call */
+    int nice;                              /* Nice level of registration */
 };
 
-/* Enumeration for Task Errors */
-enum task_status_code {
-    TS_EXIST = 0,      /* Task is still active */
-    TS_TERMINATED = -1 /* Task has terminated */
-};
+/* Lock a run queue with room for an operation on each of its waiting
+ * processes, the array of *cap entries being allocated while the lock is not
+ * held. Returns NULL without the lock should the allocation fail.
+ */
+static struct task_op *lock_rq_with_ops(struct proc_rq *rq, unsigned int *cap)
+{
+    struct task_op *ops;
 
-/* Structure for a process */
-struct proc {
-    int pid;                  /* Process ID */
-    enum process_state state; /* Process State */
-    struct list_head list;    /* List pointer for generating a list of proc */
-    /* FIXME: More things to come in future such as nice value and prio. */
-} top;
+    for (;;) {
+        *cap = READ_ONCE(rq->nr_queued) + 1;
+        ops = kvcalloc(*cap, sizeof(*ops), GFP_KERNEL);
+        if (!ops)
+            return NULL;
+        spin_lock(&rq->lock);
+        if (rq->nr_queued < *cap)
+            return ops;
+        /* More processes were queued meanwhile */
+        spin_unlock(&rq->lock);
+        kvfree(ops);
+    }
+}
 
-/* Semaphore for process queue */
-static struct semaphore mutex;
+/* change the process state of every waiting process */
+static int change_all_process_states(int changeState)
+{
+    unsigned int cap, i, nr;
+    struct task_op *ops;
+    struct proc *node;
+    struct proc_rq *rq;
+    int cpu;
 
-enum task_status_code task_status_change(int pid, enum process_state eState);
-enum task_status_code is_task_exists(int pid);
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        ops = lock_rq_with_ops(rq, &cap);
+        if (!ops)
+            return -ENOMEM;
+        nr = 0;
+        list_for_each_entry (node, &rq->members, rq_list) {
+            /* Only the waiting processes */
+            if (node == rq->running)
+                continue;
+            if (WARN_ON_ONCE(nr == cap))
+                break;
+            plugin_debug("Updating the process state the Process %d in  "
+                         "Process Queue...\n",
+                         node->pid);
+            /* Update the state to the provided state */
+            set_process_state(rq, node, changeState);
+            if (changeState == S_WAITING)
+                node->suspend = &suspend_backends[rq->policy->suspend];
+            ops[nr].tpid = get_pid(node->tpid);
+            ops[nr].backend = node->suspend;
+            ops[nr].nice = node->nice;
+            nr++;
+        }
+        spin_unlock(&rq->lock);
 
-int init_process_queue(void);
-int release_process_queue(void);
-int add_process_to_queue(int pid);
-int remove_process_from_queue(int pid);
-int print_process_queue(void);
-int change_process_state_in_queue(int pid, int changeState);
-int get_first_process_in_queue(void);
-int remove_terminated_processes_from_queue(void);
+        /* An exited task is unlinked by the exit probe */
+        for (i = 0; i < nr; i++) {
+            task_status_change(ops[i].tpid, ops[i].backend, ops[i].nice,
+                               changeState);
+            put_pid(ops[i].tpid);
+        }
+        kvfree(ops);
+    }
+    return changeState;
+}
 
-/* initialize a process queue */
-int init_process_queue(void)
+/* change the process state for a given process in the queue */
+int change_process_state_in_queue(int pid, int changeState)
 {
-    printk(KERN_INFO "Initializing the Process Queue...\n");
+    const struct suspend_backend *backend;
+    struct proc *node;
+    struct proc_rq *rq;
+    struct pid *tpid;
+    int nice;
 
-    /* Generate the head of the queue and initializing an empty proc queue */
-    INIT_LIST_HEAD(&top.list);
-    return 0;
+    int ret_process_change_status = changeState;
+
+    /* Check if all registered PIDs are modified for state */
+    if (pid == ALL_REG_PIDS)
+        return change_all_process_states(changeState);
+
+    /* Exited tasks are unlinked by the exit probe, so only the requested
+     * node is touched.
+     */
+    rq = lock_process_rq(pid, &node);
+    if (!rq)
+        return -ESRCH;
+
+    plugin_debug("Updating the process state the Process %d in  Process "
+                 "Queue...\n",
+                 pid);
+    set_process_state(rq, node, changeState);
+    if (changeState == S_WAITING)
+        node->suspend = &suspend_backends[rq->policy->suspend];
+    tpid = get_pid(node->tpid);
+    backend = node->suspend;
+    nice = node->nice;
+    spin_unlock(&rq->lock);
+
+    /* The backend may sleep, it is called without the run queue lock */
+    if (task_status_change(tpid, backend, nice, changeState) ==
+        TS_TERMINATED) {
+        /* The node may have been unlinked or registered again meanwhile */
+        rq = lock_process_rq(pid, &node);
+        if (rq) {
+            if (node->tpid == tpid)
+                mark_process_terminated(rq, node);
+            spin_unlock(&rq->lock);
+        }
+        /* Return value updated to notify that the requested process is
+         * already terminated.
+         */
+        ret_process_change_status = S_TERMINATED;
+    }
+    put_pid(tpid);
+
+    /* Return the process status change associated with the internal call to
+     * task status change method.
+     */
+    return ret_process_change_status;
 }
 
-/* release a process queue */
-int release_process_queue(void)
+
+/* histogram bucket of a time in nanoseconds */
+static unsigned int stats_bucket(u64 ns)
 {
-    struct proc *tmp, *node;
-    printk(KERN_INFO "Releasing Process Queue...\n");
+    u64 us = div_u64(ns, NSEC_PER_USEC);
 
-    /* Iterate over the list of nodes pertaining to the process information
-     * and remove one by one.
-     */
-    list_for_each_entry_safe (node, tmp, &(top.list), list) {
-        /* Deleting link pointer established by the node to the list */
-        list_del(&node->list);
-        /* Removing the whole node */
-        kfree(node);
+    if (!us)
+        return 0;
+    return min_t(unsigned int, ilog2(us) + 1, STATS_BUCKETS - 1);
+}
+
+/* print the sum of a histogram over the CPUs */
+static void stats_show_hist(struct seq_file *m, const char *name, bool tick)
+{
+    unsigned long hist[STATS_BUCKETS] = {0};
+    struct sched_stats *stats;
+    unsigned long *cpu_hist;
+    int cpu, i;
+
+    for_each_possible_cpu (cpu) {
+        stats = per_cpu_ptr(&sched_stats, cpu);
+        cpu_hist = tick ? stats->tick_hist : stats->wait_hist;
+        for (i = 0; i < STATS_BUCKETS; i++)
+            hist[i] += READ_ONCE(cpu_hist[i]);
     }
-    /* success */
+
+    seq_printf(m, "\n%s (us):\n", name);
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        if (!hist[i])
+            continue;
+        if (i == STATS_BUCKETS - 1)
+            seq_printf(m, "  %10lu - %-10s %lu\n", 1UL << (i - 1), "",
+                       hist[i]);
+        else
+            seq_printf(m, "  %10lu - %-10lu %lu\n", i ? 1UL << (i - 1) : 0,
+                       (1UL << i) - 1, hist[i]);
+    }
+}
+
+/* Per process counters and the latency histograms. The counters are written
+ * under the run queue locks and read here without them, a line may mix
+ * values from before and after a switch.
+ */
+static int stats_show(struct seq_file *m, void *v)
+{
+    struct proc *node;
+
+    seq_printf(m,
+               "%-8s %-8s %-5s %-4s %-12s %-12s %-10s %-11s %-8s %-8s\n",
+               "pid", "tgid", "state", "cpu", "run_us", "wait_us",
+               "scheduled", "involuntary", "jobs", "missed");
+    rcu_read_lock();
+    list_for_each_entry_rcu (node, &(top.list), list) {
+        seq_printf(m,
+                   "%-8d %-8d %-5d %-4d %-12llu %-12llu %-10lu %-11lu "
+                   "%-8lu %-8lu\n",
+                   node->pid, node->tgid, READ_ONCE(node->state),
+                   READ_ONCE(node->rq)->cpu,
+                   div_u64(READ_ONCE(node->run_ns), NSEC_PER_USEC),
+                   div_u64(READ_ONCE(node->wait_ns), NSEC_PER_USEC),
+                   READ_ONCE(node->nr_scheduled),
+                   READ_ONCE(node->nr_involuntary),
+                   READ_ONCE(node->se.nr_jobs),
+                   READ_ONCE(node->se.nr_missed));
+    }
+    rcu_read_unlock();
+
+    stats_show_hist(m, "wait latency", false);
+    stats_show_hist(m, "tick duration", true);
     return 0;
 }
 
-/* add a process into a queue */
-int add_process_to_queue(int pid)
+/* Map the state area read-only. The mapping holds its own references to
+ * the pages, so they outlive the area should the module go away first.
+ */
+static int state_mmap(struct file *file, struct vm_area_struct *vma)
 {
-    /* Allocating space for the newly registered process */
-    struct proc *new_process = kmalloc(sizeof(struct proc), GFP_KERNEL);
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    return remap_vmalloc_range(vma, state_area, vma->vm_pgoff);
+}
 
-    /* Check if the kmalloc call was successful or not */
-    if (!new_process) {
-        printk(KERN_ALERT
-               "Process Queue ERROR: kmalloc function failed from "
-               "add_process_to_queue function.");
-        /* Add process to queue error */
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops state_fops = {
+    .proc_mmap = state_mmap,
+};
+#else
+static const struct file_operations state_fops = {
+    .owner = THIS_MODULE,
+    .mmap = state_mmap,
+};
+#endif
+
+/* allocate the state area with one record per possible CPU and state_slots
+ * task records
+ */
+static int alloc_state_area(void)
+{
+    u32 cpu_size = ALIGN(sizeof(struct sched_state_cpu), SMP_CACHE_BYTES);
+    u32 task_size = ALIGN(sizeof(struct sched_state_task), SMP_CACHE_BYTES);
+    u32 cpu_offset = ALIGN(sizeof(struct sched_state_header), SMP_CACHE_BYTES);
+    u32 task_offset = cpu_offset + nr_cpu_ids * cpu_size;
+    u32 size = PAGE_ALIGN(task_offset + state_slots * task_size);
+    struct sched_state_header *hdr;
+    struct sched_state_cpu *sc;
+    int cpu;
+
+    state_map = bitmap_zalloc(state_slots, GFP_KERNEL);
+    state_area = vmalloc_user(size);
+    if (!state_map || !state_area) {
+        bitmap_free(state_map);
+        vfree(state_area);
+        state_map = NULL;
+        state_area = NULL;
         return -ENOMEM;
     }
 
-    /* Setting the process id to the process info node new_process */
-    new_process->pid = pid;
+    hdr = state_header();
+    hdr->magic = SCHED_STATE_MAGIC;
+    hdr->version = SCHED_STATE_VERSION;
+    hdr->size = size;
+    hdr->nr_cpus = nr_cpu_ids;
+    hdr->cpu_offset = cpu_offset;
+    hdr->cpu_size = cpu_size;
+    hdr->nr_slots = state_slots;
+    hdr->task_offset = task_offset;
+    hdr->task_size = task_size;
+    for_each_possible_cpu (cpu) {
+        sc = state_cpu(cpu);
+        sc->running_pid = INVALID_PID;
+        sc->active = cpumask_test_cpu(cpu, &plugin_cpus);
+    }
+    return 0;
+}
 
-    /* Setting process state to the process info node new_process as waiting */
-    new_process->state = S_WAITING;
+static void free_state_area(void)
+{
+    vfree(state_area);
+    bitmap_free(state_map);
+    state_area = NULL;
+    state_map = NULL;
+}
 
-    /* Make the task level alteration therefore the process pauses its execution
-     * since in wait state.
-     */
-    task_status_change(new_process->pid, new_process->state);
-    /* TODO: add error handling */
+/* Send an event to the notification files of a process, dropping the
+ * oldest event of a full file. Called from the rotations and from the
+ * warning timer of the scheduler.
+ */
+void process_queue_notify(int pid, enum sched_plugin_notify event)
+{
+    struct proc_notify *n;
+    unsigned long flags;
 
-    /* Condition to verify the down operation on the binary semaphore.
-     * Entry into a Mutually exclusive block is granted by having a successful
-     * lock with the mentioned semaphore.
-     * binary semaphore provides a safe access to following critical section.
-     */
-    if (down_interruptible(&mutex)) {
-        printk(KERN_ALERT
-               "Process Queue ERROR:Mutual Exclusive position access failed "
-               "from add function");
-        /* Issue a restart of syscall which was supposed to be executed */
-        return -ERESTARTSYS;
+    if (!READ_ONCE(nr_notify) || pid <= 0)
+        return;
+    rcu_read_lock();
+    hash_for_each_possible_rcu (notify_table, n, hnode, pid) {
+        if (n->pid != pid)
+            continue;
+        spin_lock_irqsave(&n->wait.lock, flags);
+        if (n->head - n->tail == NOTIFY_EVENTS)
+            n->tail++;
+        n->events[n->head++ % NOTIFY_EVENTS] = event;
+        wake_up_locked_poll(&n->wait, EPOLLIN | EPOLLRDNORM);
+        spin_unlock_irqrestore(&n->wait.lock, flags);
     }
+    rcu_read_unlock();
+}
 
-    /* Initialize the new process list as the new head. */
-    INIT_LIST_HEAD(&new_process->list);
+/* Longest lead time the notification files of a process ask for, 0 when
+ * none wants to be warned of the end of its quantum
+ */
+u64 process_queue_notify_lead(int pid)
+{
+    struct proc_notify *n;
+    u64 lead = 0;
 
-    /* Set the new process as a tail to the previous top of the list */
-    list_add_tail(&(new_process->list), &(top.list));
+    if (!READ_ONCE(nr_notify) || pid <= 0)
+        return 0;
+    rcu_read_lock();
+    hash_for_each_possible_rcu (notify_table, n, hnode, pid) {
+        if (n->pid == pid)
+            lead = max(lead, READ_ONCE(n->lead_ns));
+    }
+    rcu_read_unlock();
+    return lead;
+}
 
-    /* Such an operation indicates the critical section is released for other
-     * processes/threads.
-     */
-    up(&mutex);
+/* Switch a running process out on its own request, its CPU switching right
+ * away instead of at the end of the quantum. A process which is not running
+ * has nothing to give up.
+ */
+static int yield_process(int pid)
+{
+    void (*resched)(int cpu);
+    struct proc_rq *rq;
+    struct proc *node;
+    int cpu;
 
-    printk(KERN_INFO "Adding the given Process %d to the  Process Queue...\n",
-           pid);
-    /* success */
+    rq = lock_process_rq(pid, &node);
+    if (!rq)
+        return -ESRCH;
+    if (node != rq->running) {
+        spin_unlock(&rq->lock);
+        return 0;
+    }
+    WRITE_ONCE(rq->yield_pid, pid);
+    cpu = rq->cpu;
+    spin_unlock(&rq->lock);
+
+    rcu_read_lock();
+    resched = rcu_dereference(resched_hook);
+    if (resched)
+        resched(cpu);
+    rcu_read_unlock();
     return 0;
 }
 
-/* remove a specified process from the queue */
-int remove_process_from_queue(int pid)
+/* the notification file belongs to the task opening it */
+static int notify_open(struct inode *inode, struct file *file)
 {
-    struct proc *tmp, *node;
-    if (down_interruptible(&mutex)) {
-        printk(KERN_ALERT
-               "Process Queue ERROR:Mutual Exclusive position access failed "
-               "from remove function");
-        /* Issue a restart of syscall which was supposed to be executed */
-        return -ERESTARTSYS;
-    }
-
-    /* Iterate over process queue and remove the process with provided PID */
-    list_for_each_entry_safe (node, tmp, &(top.list), list) {
-        /** Check if the node pid is the same as the required pid */
-        if (node->pid == pid) {
-            printk(KERN_INFO
-                   "Removing the given Process %d from the  Process Queue...\n",
-                   pid);
-            /* Deleting link pointer established by the node to the list */
-            list_del(&node->list);
+    struct proc_notify *n = kzalloc(sizeof(*n), GFP_KERNEL);
 
-            /* Removing the whole node */
-            kfree(node);
-        }
-    }
+    if (!n)
+        return -ENOMEM;
+    n->pid = task_pid_nr(current);
+    init_waitqueue_head(&n->wait);
+    file->private_data = n;
 
-    up(&mutex);
-    /* success */
+    spin_lock(&notify_lock);
+    hash_add_rcu(notify_table, &n->hnode, n->pid);
+    nr_notify++;
+    spin_unlock(&notify_lock);
     return 0;
 }
 
-/* remove all terminated processes from the queue */
-int remove_terminated_processes_from_queue(void)
+static int notify_release(struct inode *inode, struct file *file)
 {
-    struct proc *tmp, *node;
-    if (down_interruptible(&mutex)) {
-        printk(KERN_ALERT
-               "Process Queue ERROR:Mutual Exclusive position access failed "
-               "from remove function");
-        /* Issue a restart of syscall which was supposed to be executed */
-        return -ERESTARTSYS;
-    }
-    /* Iterate over proc queue and remove all terminated processes from queue */
-    list_for_each_entry_safe (node, tmp, &(top.list), list) {
-        /* Check if the process is terminated or not */
-        if (node->state == S_TERMINATED) {
-            printk(KERN_INFO
-                   "Removing the terminated Process %d from the Process "
-                   "Queue...\n",
-                   node->pid);
-            /* Delete link pointer established by the node to the list */
-            list_del(&node->list);
-            /* Remove the whole node */
-            kfree(node);
-        }
-    }
+    struct proc_notify *n = file->private_data;
 
-    up(&mutex);
-    /* success */
+    spin_lock(&notify_lock);
+    hash_del_rcu(&n->hnode);
+    nr_notify--;
+    spin_unlock(&notify_lock);
+    kfree_rcu(n, rcu);
     return 0;
 }
 
-/* change the process state for a given process in the queue */
-int change_process_state_in_queue(int pid, int changeState)
+/* Read the pending events one per line, waiting for one unless the file is
+ * non-blocking. Only whole lines are returned.
+ */
+static ssize_t notify_read(struct file *file,
+                           char __user *ubuf,
+                           size_t count,
+                           loff_t *ppos)
 {
-    struct proc *tmp, *node;
-
-    enum process_state ret_process_change_status;
+    struct proc_notify *n = file->private_data;
+    char buf[128];
+    size_t len = 0;
+    const char *name;
+    int ret;
 
-    if (down_interruptible(&mutex)) {
-        printk(KERN_ALERT
-               "Process Queue ERROR:Mutual Exclusive position access failed "
-               "from change process state function");
-        /* Issue a restart of syscall which was supposed to be executed */
-        return -ERESTARTSYS;
+    spin_lock_irq(&n->wait.lock);
+    if (file->f_flags & O_NONBLOCK) {
+        ret = n->head == n->tail ? -EAGAIN : 0;
+    } else {
+        ret = wait_event_interruptible_locked_irq(
+            n->wait, n->head != n->tail || READ_ONCE(notify_closing));
     }
-    /* Check if all registered PIDs are modified for state */
-    if (pid == ALL_REG_PIDS) {
-        list_for_each_entry_safe (node, tmp, &(top.list), list) {
-            printk(KERN_INFO
-                   "Updating the process state the Process %d in  Process "
-                   "Queue...\n",
-                   node->pid);
-            /* Update the state to the provided state */
-            node->state = changeState;
-            /* Check if the task associated with iterated node still exists */
-            if (task_status_change(node->pid, node->state) == TS_TERMINATED) {
-                node->state = S_TERMINATED;
-            }
+    while (!ret && n->head != n->tail) {
+        name = notify_names[n->events[n->tail % NOTIFY_EVENTS]];
+        if (len + strlen(name) + 1 > min(count, sizeof(buf))) {
+            /* Too short a buffer for even one line */
+            if (!len)
+                ret = -EINVAL;
+            break;
         }
+        len += scnprintf(buf + len, sizeof(buf) - len, "%s\n", name);
+        n->tail++;
+    }
+    spin_unlock_irq(&n->wait.lock);
+
+    if (ret)
+        return ret;
+    if (copy_to_user(ubuf, buf, len))
+        return -EFAULT;
+    return len;
+}
+
+/* "yield" gives the CPU up right away, "lead=<us>" asks for a warning that
+ * long before the end of each quantum, 0 for none
+ */
+static ssize_t notify_write(struct file *file,
+                            const char __user *ubuf,
+                            size_t count,
+                            loff_t *ppos)
+{
+    struct proc_notify *n = file->private_data;
+    char buf[32], *cmd;
+    unsigned int us;
+    int ret;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+    cmd = strim(buf);
+
+    if (!strcmp(cmd, "yield")) {
+        ret = yield_process(n->pid);
+    } else if (!strncmp(cmd, "lead=", 5)) {
+        ret = kstrtouint(cmd + 5, 10, &us);
+        if (!ret)
+            WRITE_ONCE(n->lead_ns, (u64) us * NSEC_PER_USEC);
     } else {
-        list_for_each_entry_safe (node, tmp, &(top.list), list) {
-            /**Check if the iterated node is the required process or not.*/
-            if (node->pid == pid) {
-                printk(KERN_INFO
-                       "Updating the process state the Process %d in  Process "
-                       "Queue...\n",
-                       pid);
-                node->state = changeState;
-                if (task_status_change(node->pid, node->state) ==
-                    TS_TERMINATED) {
-                    node->state = S_TERMINATED;
-                    /* Return value updated to notify that the requested process
-                     * is already terminated.
-                     */
-                    ret_process_change_status = S_TERMINATED;
-                }
-            } else {
-                /* Check if task associated with the iterated node exists */
-                if (is_task_exists(node->pid) == TS_TERMINATED) {
-                    node->state = S_TERMINATED;
-                }
-            }
-        }
+        ret = -EINVAL;
     }
+    return ret ? ret : count;
+}
 
-    up(&mutex);
+static __poll_t notify_poll(struct file *file, poll_table *wait)
+{
+    struct proc_notify *n = file->private_data;
 
-    /* Return the process status change associated with the internal call to
-     * task status change method.
-     */
-    return ret_process_change_status;
+    poll_wait(file, &n->wait, wait);
+    if (READ_ONCE(n->head) != READ_ONCE(n->tail))
+        return EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+    return EPOLLOUT | EPOLLWRNORM;
 }
 
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops notify_fops = {
+    .proc_open = notify_open,
+    .proc_read = notify_read,
+    .proc_write = notify_write,
+    .proc_poll = notify_poll,
+    .proc_lseek = noop_llseek,
+    .proc_release = notify_release,
+};
+#else
+static const struct file_operations notify_fops = {
+    .owner = THIS_MODULE,
+    .open = notify_open,
+    .read = notify_read,
+    .write = notify_write,
+    .poll = notify_poll,
+    .llseek = noop_llseek,
+    .release = notify_release,
+};
+#endif
+
+/* Wake the readers of the notification files up for good, so that removing
+ * the file does not wait for them
+ */
+static void notify_shutdown(void)
+{
+    struct proc_notify *n;
+    int bkt;
+
+    WRITE_ONCE(notify_closing, true);
+    spin_lock(&notify_lock);
+    hash_for_each (notify_table, bkt, n, hnode)
+        wake_up_all(&n->wait);
+    spin_unlock(&notify_lock);
+}
 
 int print_process_queue(void)
 {
     struct proc *tmp;
     printk(KERN_INFO "Process Queue: \n");
-    if (down_interruptible(&mutex)) {
-        printk(KERN_ALERT
-               "Process Queue ERROR:Mutual Exclusive position access failed "
-               "from print function");
-        return -ERESTARTSYS;
-    }
+    rcu_read_lock();
 
-    list_for_each_entry (tmp, &(top.list), list) {
-        printk(KERN_INFO "Process ID: %d\n", tmp->pid);
+    list_for_each_entry_rcu (tmp, &(top.list), list) {
+        printk(KERN_INFO "Process ID: %d CPU: %d State: %d\n", tmp->pid,
+               READ_ONCE(tmp->rq)->cpu, READ_ONCE(tmp->state));
+        if (READ_ONCE(tmp->se.dl_period))
+            printk(KERN_INFO "  Deadline misses: %lu of %lu periods\n",
+                   READ_ONCE(tmp->se.nr_missed), READ_ONCE(tmp->se.nr_jobs));
     }
 
-    up(&mutex);
+    rcu_read_unlock();
     return 0;
 }
 
@@ -296,87 +3220,553 @@ int get_first_process_in_queue(void)
     /* Initially set the process id value as an INVALID value */
     int pid = INVALID_PID;
 
-    if (down_interruptible(&mutex)) {
-        printk(KERN_ALERT
-               "Process Queue ERROR:Mutual Exclusive position access failed "
-               "from print function");
-        /* Issue a restart of syscall which was supposed to be executed */
-        return -ERESTARTSYS;
-    }
+    rcu_read_lock();
 
-    /* Iterate over the process queue and find the first active process */
-    list_for_each_entry (tmp, &(top.list), list) {
-        /* Check if the task associated with the process is terminated */
-        if ((pid == INVALID_PID) && (is_task_exists(tmp->pid) == TS_EXIST)) {
+    /* Iterate over the registered processes and find the first one waiting
+     * for a CPU, exited tasks are not on the list any more.
+     */
+    list_for_each_entry_rcu (tmp, &(top.list), list) {
+        if (READ_ONCE(tmp->state) == S_WAITING) {
             /* Set the process id to read process */
             pid = tmp->pid;
+            break;
         }
     }
 
-    up(&mutex);
+    rcu_read_unlock();
 
     /* Returns the first process ID */
     return pid;
 }
 
-enum task_status_code is_task_exists(int pid)
+/* Perform one round robin step on the run queue of a CPU under a single lock
+ * acquisition: move the outgoing node to the tail, reap entries marked
+ * terminated met at the front, pop the first live PID, mark it running and
+ * pin it to the CPU. Exited tasks have been unlinked by the exit probe.
+ * A drained run queue first steals a process from the busiest one. The nodes
+ * only change lists, so a rotation never allocates. The policy of the run
+ * queue orders the processes and decides whether the outgoing one is
+ * preempted at all. An outgoing process which fell asleep is switched out
+ * regardless, and waiting processes asleep are passed over.
+ * Returns the new running PID or INVALID_PID.
+ */
+int rotate_process_queue(int cpu, int prev_pid)
 {
-    struct task_struct *current_pr;
-    current_pr = pid_task(find_vpid(pid), PIDTYPE_PID);
-    /* Check if the task exists or not by checking for NULL Value */
-    if (current_pr == NULL) {
-        /* Return the task status code as terminated */
-        return TS_TERMINATED;
+    struct proc *node, *next_node = NULL, *skipped = NULL, *released;
+    struct proc *prev_node = NULL;
+    int nr_skipped = 0;
+    bool asleep = false, yield;
+    u64 now, tick_ns = 0, wait_ns = 0;
+    struct pid *prev_tpid = NULL, *next_tpid = NULL;
+    const struct suspend_backend *prev_backend = NULL, *next_backend = NULL;
+    struct proc_rq *rq;
+    int next_pid = INVALID_PID, prev_nice = 0, next_nice = 0;
+    int curr_pid = INVALID_PID;
+
+    if (!cpumask_test_cpu(cpu, &plugin_cpus))
+        return INVALID_PID;
+    rq = per_cpu_ptr(&proc_rqs, cpu);
+
+    if (!READ_ONCE(rq->nr_queued))
+        steal_process(rq);
+
+    spin_lock(&rq->lock);
+    now = ktime_get_ns();
+    if (rq->last_rotation)
+        tick_ns = now - rq->last_rotation;
+    rq->last_rotation = now;
+
+    /* Another CPU may have released a gang member waiting here or
+     * descheduled the gang of the running process, or the running process
+     * yielded through its notification file
+     */
+    released = gang_released(rq);
+    yield = xchg(&rq->yield_pid, 0) == prev_pid;
+
+    /* The outgoing process goes on while it is alive, i.e. while the exit
+     * probe has not unlinked it, unless its policy preempts it, it fell
+     * asleep, it yielded or its gang gives way. The running node is the
+     * outgoing process whatever prev_pid the caller remembers, e.g. after
+     * proc_sched was loaded again: prev_pid only tells whether the yield
+     * request is meant for it.
+     */
+    if (rq->running) {
+        curr_pid = rq->running->pid;
+        asleep = task_asleep(rq->running);
+        /* Tells the policy whether the process blocked, its job done */
+        rq->running->se.sleeping = asleep;
+        update_curr(rq->running);
+        if (!policy_tick(rq, rq->running) && !asleep && !released &&
+            !yield) {
+            state_publish_rq(rq, true, false);
+            spin_unlock(&rq->lock);
+            this_cpu_inc(sched_stats.tick_hist[stats_bucket(tick_ns)]);
+            return curr_pid;
+        }
+
+        /* Queue the outgoing process again */
+        node = rq->running;
+        set_running(rq, NULL);
+        node->se.wait_start = ktime_get_ns();
+        node->run_ns += node->se.wait_start - node->se.exec_start;
+        if (!asleep)
+            node->nr_involuntary++;
+        set_process_state(rq, node, asleep ? S_BLOCKING : S_WAITING);
+        policy_enqueue(rq, node);
+        /* A thread blocking does not hold up the rest of its gang, and
+         * starts a new slice when it runs again, as one yielding does
+         */
+        if (!asleep && !yield)
+            prev_node = node;
+        else
+            node->se.slice_ticks = 0;
+        prev_tpid = get_pid(node->tpid);
+        prev_backend = node->suspend = &suspend_backends[rq->policy->suspend];
+        prev_nice = node->nice;
     }
-    /* Return the task status code as exists */
-    return TS_EXIST;
+
+    /* Pick the next live process, reaping the dead ones picked before it.
+     * A process asleep is put back for a while, unless the policy insists on
+     * it by picking it again. Only the idle backend lets a waiting process
+     * run into a sleep; one stopped by the signal backend never shows it, so
+     * the check is not even made. A released gang member goes first.
+     */
+    while (!released && (node = policy_pick_next(rq))) {
+        if (node->state == S_TERMINATED) {
+            plugin_info("Removing the terminated Process %d from the Process "
+                        "Queue...\n",
+                        node->pid);
+            unlink_process(rq, node);
+            continue;
+        }
+        if (node != skipped && nr_skipped < PICK_SKIP_MAX &&
+            node->suspend == &suspend_backends[SUSPEND_IDLE] &&
+            task_asleep(node)) {
+            policy_dequeue(rq, node);
+            set_process_state(rq, node, S_BLOCKING);
+            node->se.sleeping = true;
+            policy_enqueue(rq, node);
+            skipped = node;
+            nr_skipped++;
+            continue;
+        }
+        next_node = node;
+        break;
+    }
+    if (released)
+        next_node = released;
+    rq->last_picked = next_node && next_node->pid != curr_pid;
+    if (next_node) {
+        next_pid = next_node->pid;
+        policy_dequeue(rq, next_node);
+        start_curr(next_node);
+        if (rq->last_picked) {
+            wait_ns = next_node->se.exec_start - next_node->se.wait_start;
+            rq->last_wait_ns = wait_ns;
+            next_node->wait_ns += wait_ns;
+            next_node->nr_scheduled++;
+        }
+        set_process_state(rq, next_node, S_RUNNING);
+        trace_sched_plugin_pick(cpu, curr_pid, next_pid, rq->nr_queued,
+                                wait_ns);
+        set_running(rq, next_node);
+        next_tpid = get_pid(next_node->tpid);
+        next_backend = next_node->suspend;
+        next_nice = next_node->nice;
+    }
+
+    /* The gang of a process given the CPU by the policy runs with it on the
+     * other CPUs, the one of a preempted process gives way there too
+     */
+    if (prev_node && prev_node != next_node &&
+        (!next_node || prev_node->gang != next_node->gang))
+        gang_signal(rq, prev_node, false);
+    if (next_node && next_node != released && rq->last_picked &&
+        (!prev_node || prev_node->gang != next_node->gang))
+        gang_signal(rq, next_node, true);
+
+    state_publish_rq(rq, true, rq->last_picked);
+    spin_unlock(&rq->lock);
+
+    this_cpu_inc(sched_stats.tick_hist[stats_bucket(tick_ns)]);
+    if (rq->last_picked)
+        this_cpu_inc(sched_stats.wait_hist[stats_bucket(wait_ns)]);
+    if (prev_tpid && asleep)
+        plugin_event(EV_BLOCK, curr_pid, cpu);
+    if (next_pid != curr_pid) {
+        plugin_event(EV_SWITCH, next_pid, curr_pid);
+        if (prev_tpid)
+            process_queue_notify(curr_pid, SCHED_NOTIFY_OUT);
+        if (next_tpid)
+            process_queue_notify(next_pid, SCHED_NOTIFY_IN);
+    }
+
+    /* Signal the tasks outside of the critical section, the PID references
+     * keep them valid should the nodes be unlinked meanwhile. A process
+     * picked once more simply goes on, it is neither stopped nor continued.
+     */
+    if (prev_tpid && prev_tpid == next_tpid) {
+        put_pid(prev_tpid);
+        put_pid(next_tpid);
+        prev_tpid = next_tpid = NULL;
+    }
+    if (prev_tpid) {
+        task_status_change(prev_tpid, prev_backend, prev_nice, S_WAITING);
+        put_pid(prev_tpid);
+    }
+    if (next_tpid) {
+        set_task_affinity(next_tpid, cpumask_of(cpu));
+        task_status_change(next_tpid, next_backend, next_nice, S_RUNNING);
+        put_pid(next_tpid);
+    }
+
+    return next_pid;
 }
 
-enum task_status_code task_status_change(int pid, enum process_state eState)
+enum task_status_code task_status_change(
+    struct pid *pid,
+    const struct suspend_backend *backend,
+    int nice,
+    enum process_state eState)
 {
     struct task_struct *current_pr;
-    /* Obtain the task struct associated with provided PID */
-    current_pr = pid_task(find_vpid(pid), PIDTYPE_PID);
-    if (current_pr == NULL) {
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench_running)
+        return TS_EXIST;
+#endif
+    /* Obtain the task struct associated with provided PID, a task already
+     * exiting has been or is about to be unlinked by the exit probe
+     */
+    current_pr = get_pid_task(pid, PIDTYPE_PID);
+    if (current_pr == NULL)
+        return TS_TERMINATED;
+    if (current_pr->flags & PF_EXITING) {
+        put_task_struct(current_pr);
         return TS_TERMINATED;
     }
 
+    plugin_event(EV_STATE, pid_nr(pid), eState);
+    trace_sched_plugin_task_status(pid_nr(pid), eState,
+                                   backend - suspend_backends);
+
     /* Check if the state change was Running */
     if (eState == S_RUNNING) {
-        /* Trigger a signal to continue the given task associated with the
-         * process.
-         */
-        kill_pid(task_pid(current_pr), SIGCONT, 1);
-        printk(KERN_INFO "Task status change to Running\n");
+        /* Continue the given task associated with the process */
+        backend->resume(current_pr, nice);
+        plugin_debug("Task status change to Running\n");
     } else if (eState == S_WAITING) { /* if state change was Waiting */
-        /* Trigger a signal to pause the given task associated with the
-         * process.
-         */
-        kill_pid(task_pid(current_pr), SIGSTOP, 1);
-        printk(KERN_INFO "Task status change to Waiting\n");
+        /* Pause the given task associated with the process */
+        backend->suspend(current_pr);
+        plugin_debug("Task status change to Waiting\n");
     } else if (eState == S_BLOCKING) { /* if state change was Blocked */
-        printk(KERN_INFO "Task status change to Blocked\n");
+        plugin_debug("Task status change to Blocked\n");
     } else if (eState == S_TERMINATED) { /* if state change was Terminated */
-        printk(KERN_INFO "Task status change to Terminated\n");
+        plugin_debug("Task status change to Terminated\n");
     }
+    put_task_struct(current_pr);
 
     /* Return the task status code as exists */
     return TS_EXIST;
 }
 
+/* hand a task no longer scheduled by the plugin back to the kernel */
+static void task_release(struct pid *pid,
+                         const struct suspend_backend *backend,
+                         int nice)
+{
+    struct task_struct *task;
+
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench_running)
+        return;
+#endif
+    task = get_pid_task(pid, PIDTYPE_PID);
+    if (!task)
+        return;
+    backend->release(task, nice);
+    put_task_struct(task);
+}
+
+#ifdef SCHED_PLUGIN_BENCH
+/* Self benchmark of the queue operations, built with "make BENCH=1" and run
+ * with "insmod proc_queue.ko bench=1" while no other module is loaded.
+ * Synthetic PIDs above PID_MAX_LIMIT are used so no task is ever signalled.
+ * All of them go to the run queue of the first plugin CPU.
+ */
+#define BENCH_PID_BASE (PID_MAX_LIMIT + 1)
+#define BENCH_LOOKUPS 1000
+#define BENCH_TICKS 1000
+
+static bool bench;
+module_param(bench, bool, 0);
+
+/* linear walk of the registered list, the lookup cost before the hash
+ * table
+ */
+static struct proc *bench_scan_queue(int pid)
+{
+    struct proc *node;
+
+    list_for_each_entry_rcu (node, &(top.list), list) {
+        if (node->pid == pid)
+            return node;
+    }
+    return NULL;
+}
+
+static void bench_queue_size(int n)
+{
+    u64 t_add, t_find, t_scan, t_remove, t_tick, t0;
+    int i, pid, cpu = cpumask_first(&plugin_cpus);
+    struct proc_rq *rq = per_cpu_ptr(&proc_rqs, cpu);
+    unsigned long allocs;
+    struct proc *node;
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < n; i++) {
+        node = alloc_process(BENCH_PID_BASE + i);
+        if (!node)
+            break;
+        spin_lock(&rq->lock);
+        link_process(rq, node);
+        spin_unlock(&rq->lock);
+    }
+    t_add = ktime_get_ns() - t0;
+    n = i;
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < BENCH_LOOKUPS; i++) {
+        pid = BENCH_PID_BASE + (i * 7919) % n;
+        rq = lock_process_rq(pid, &node);
+        if (rq)
+            spin_unlock(&rq->lock);
+    }
+    t_find = ktime_get_ns() - t0;
+
+    rq = per_cpu_ptr(&proc_rqs, cpu);
+    t0 = ktime_get_ns();
+    for (i = 0; i < BENCH_LOOKUPS; i++) {
+        pid = BENCH_PID_BASE + (i * 7919) % n;
+        spin_lock(&rq->lock);
+        rcu_read_lock();
+        bench_scan_queue(pid);
+        rcu_read_unlock();
+        spin_unlock(&rq->lock);
+        cond_resched();
+    }
+    t_scan = ktime_get_ns() - t0;
+
+    pid = INVALID_PID;
+    spin_lock(&table_lock);
+    allocs = nr_allocs;
+    spin_unlock(&table_lock);
+    t0 = ktime_get_ns();
+    for (i = 0; i < BENCH_TICKS; i++)
+        pid = rotate_process_queue(cpu, pid);
+    t_tick = ktime_get_ns() - t0;
+    spin_lock(&table_lock);
+    allocs = nr_allocs - allocs;
+    spin_unlock(&table_lock);
+
+    t0 = ktime_get_ns();
+    for (i = 0; i < n; i++) {
+        rq = lock_process_rq(BENCH_PID_BASE + n - 1 - i, &node);
+        if (rq) {
+            unlink_process(rq, node);
+            spin_unlock(&rq->lock);
+        }
+    }
+    t_remove = ktime_get_ns() - t0;
+
+    printk(KERN_INFO
+           "bench: n=%d add=%llu lookup=%llu scan=%llu remove=%llu ns/op\n",
+           n, div_u64(t_add, n), div_u64(t_find, BENCH_LOOKUPS),
+           div_u64(t_scan, BENCH_LOOKUPS), div_u64(t_remove, n));
+    printk(KERN_INFO
+           "bench: n=%d rotate=%llu ns/tick, %lu allocations in %d "
+           "rotations\n",
+           n, div_u64(t_tick, BENCH_TICKS), allocs, BENCH_TICKS);
+}
+
+static void bench_process_queue(void)
+{
+    static const int sizes[] = {10, 1000, 100000};
+    int i;
+
+    bench_running = true;
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+        bench_queue_size(sizes[i]);
+    bench_running = false;
+}
+#endif
+
+/* give the run queue states of the active policy back */
+static void free_policy_rqs(void)
+{
+    struct proc_rq *rq;
+    int cpu;
+
+    for_each_cpu (cpu, &plugin_cpus) {
+        rq = per_cpu_ptr(&proc_rqs, cpu);
+        policy_free_rq(rq->policy, rq->priv);
+    }
+}
+
 static int __init process_queue_module_init(void)
 {
+    struct sched_plugin_policy *policy;
+    int cpu, i, ret;
+
     printk(KERN_INFO "Process Queue module is being loaded.\n");
-    sema_init(&mutex, 1);
 
-    init_process_queue();
+    /* Restrict the run queues to the requested online CPUs */
+    cpumask_copy(&plugin_cpus, cpu_online_mask);
+    if (cpus) {
+        if (cpulist_parse(cpus, &plugin_cpus)) {
+            printk(KERN_ERR "Process Queue ERROR: invalid CPU list %s\n", cpus);
+            return -EINVAL;
+        }
+        cpumask_and(&plugin_cpus, &plugin_cpus, cpu_online_mask);
+    }
+    if (cpumask_empty(&plugin_cpus)) {
+        printk(KERN_ERR "Process Queue ERROR: no online CPU to schedule on\n");
+        return -EINVAL;
+    }
+
+    proc_cache = kmem_cache_create("sched_plugin_proc", sizeof(struct proc),
+                                   0, 0, NULL);
+    if (!proc_cache) {
+        printk(KERN_ERR "Process Queue ERROR: slab cache cannot be created\n");
+        return -ENOMEM;
+    }
+
+    ret = init_process_queue();
+    if (ret) {
+        printk(KERN_ERR
+               "Process Queue ERROR: lookup table cannot be created\n");
+        goto err_cache;
+    }
+    if (sched_plugin_log_level < SCHED_LOG_ERR ||
+        sched_plugin_log_level > SCHED_LOG_DEBUG)
+        sched_plugin_log_level = SCHED_LOG_ERR;
+    set_log_level(sched_plugin_log_level);
+
+    ret = -ENOMEM;
+    sched_plugin_dir = proc_mkdir("sched_plugin", NULL);
+    if (!sched_plugin_dir) {
+        printk(KERN_ALERT "Error: Could not initialize /proc/sched_plugin\n");
+        goto err_log;
+    }
+    for (i = 0; i < ARRAY_SIZE(queue_tunables); i++) {
+        if (sched_plugin_add_tunable(&queue_tunables[i]))
+            goto err_dir;
+    }
+    if (!proc_create_single("stats", 0444, sched_plugin_dir, stats_show) ||
+        !proc_create("notify", 0600, sched_plugin_dir, &notify_fops)) {
+        printk(KERN_ALERT
+               "Error: Could not initialize /proc/sched_plugin/stats or "
+               "notify\n");
+        goto err_dir;
+    }
+
+    /* Exited tasks are unlinked right away instead of being polled for */
+    ret = -ENOENT;
+    for_each_kernel_tracepoint(find_tracepoints, NULL);
+    if (!exit_tracepoint ||
+        tracepoint_probe_register(exit_tracepoint, process_exit_tp, NULL)) {
+        printk(KERN_ERR
+               "Process Queue ERROR: cannot hook sched_process_exit\n");
+        goto err_dir;
+    }
+
+    /* A running process which blocks hands its CPU on right away */
+    if (!switch_tracepoint ||
+        tracepoint_probe_register(switch_tracepoint, process_switch_tp,
+                                  NULL)) {
+        printk(KERN_ERR "Process Queue ERROR: cannot hook sched_switch\n");
+        goto err_exit_probe;
+    }
+
+    /* Built-in policies, every run queue starts out with round robin */
+    list_add_tail(&rr_policy.list, &policies);
+    list_add_tail(&fifo_policy.list, &policies);
+    mutex_lock(&policy_mutex);
+    policy = find_policy(default_policy);
+    ret = policy ? switch_policy(policy) : -EINVAL;
+    mutex_unlock(&policy_mutex);
+    if (ret) {
+        printk(KERN_ERR "Process Queue ERROR: cannot select policy %s\n",
+               default_policy);
+        goto err_policy;
+    }
+#ifdef SCHED_PLUGIN_BENCH
+    if (bench)
+        bench_process_queue();
+#endif
+
+    /* Event rings under /sys/kernel/debug/sched_plugin, only for debugging
+     * so their absence is no error
+     */
+    debugfs_dir = debugfs_create_dir("sched_plugin", NULL);
+    debugfs_create_file("events", 0400, debugfs_dir, NULL, &event_fops);
+
+    /* Shared state area, only for monitoring so its absence is no error.
+     * Nothing is registered yet, the records are published from here on.
+     */
+    state_slots = min(state_slots, STATE_SLOTS_MAX);
+    if (state_slots && alloc_state_area())
+        printk(KERN_WARNING
+               "Process Queue: no memory for the shared state area\n");
+    if (state_area &&
+        !proc_create("state", 0444, sched_plugin_dir, &state_fops)) {
+        printk(KERN_WARNING
+               "Process Queue: could not create /proc/sched_plugin/state\n");
+        free_state_area();
+    }
     return 0;
+
+err_policy:
+    /* Give back the run queue states of whichever policy is left active */
+    free_policy_rqs();
+    list_del(&fifo_policy.list);
+    list_del(&rr_policy.list);
+    tracepoint_probe_unregister(switch_tracepoint, process_switch_tp, NULL);
+    tracepoint_synchronize_unregister();
+    for_each_possible_cpu (cpu)
+        irq_work_sync(&per_cpu_ptr(&proc_rqs, cpu)->block_work);
+err_exit_probe:
+    tracepoint_probe_unregister(exit_tracepoint, process_exit_tp, NULL);
+    tracepoint_synchronize_unregister();
+err_dir:
+    proc_remove(sched_plugin_dir);
+err_log:
+    /* Patch the logging jumps back out */
+    set_log_level(SCHED_LOG_ERR);
+    rhashtable_destroy(&proc_table);
+err_cache:
+    kmem_cache_destroy(proc_cache);
+    return ret;
 }
 
 static void __exit process_queue_module_cleanup(void)
 {
     printk(KERN_INFO "Process Queue module is being unloaded.\n");
+    notify_shutdown();
+    proc_remove(sched_plugin_dir);
+    debugfs_remove_recursive(debugfs_dir);
+    unregister_probes();
     release_process_queue();
+    free_policy_rqs();
+    free_state_area();
+    /* Wait for the nodes still pending in RCU callbacks, and for event
+     * writers which saw the key enabled
+     */
+    static_branch_disable(&sched_plugin_event_key);
+    synchronize_rcu();
+    rcu_barrier();
+    free_event_rings();
+    rhashtable_destroy(&proc_table);
+    kmem_cache_destroy(proc_cache);
 }
 
 module_init(process_queue_module_init);
@@ -385,8 +3775,28 @@ module_exit(process_queue_module_cleanup);
 EXPORT_SYMBOL_GPL(init_process_queue);
 EXPORT_SYMBOL_GPL(release_process_queue);
 EXPORT_SYMBOL_GPL(add_process_to_queue);
+EXPORT_SYMBOL_GPL(add_processes_to_queue);
 EXPORT_SYMBOL_GPL(remove_process_from_queue);
+EXPORT_SYMBOL_GPL(transfer_process_tickets);
 EXPORT_SYMBOL_GPL(print_process_queue);
 EXPORT_SYMBOL_GPL(get_first_process_in_queue);
 EXPORT_SYMBOL_GPL(change_process_state_in_queue);
 EXPORT_SYMBOL_GPL(remove_terminated_processes_from_queue);
+EXPORT_SYMBOL_GPL(rotate_process_queue);
+EXPORT_SYMBOL_GPL(process_queue_cpumask);
+EXPORT_SYMBOL_GPL(process_queue_set_resched);
+EXPORT_SYMBOL_GPL(process_queue_set_kick);
+EXPORT_SYMBOL_GPL(process_queue_need_tick);
+EXPORT_SYMBOL_GPL(process_queue_load);
+EXPORT_SYMBOL_GPL(process_queue_notify);
+EXPORT_SYMBOL_GPL(process_queue_notify_lead);
+EXPORT_SYMBOL_GPL(sched_plugin_add_tunable);
+EXPORT_SYMBOL_GPL(sched_plugin_remove_tunable);
+EXPORT_SYMBOL_GPL(sched_plugin_register_policy);
+EXPORT_SYMBOL_GPL(sched_plugin_unregister_policy);
+EXPORT_SYMBOL_GPL(sched_plugin_log_level);
+EXPORT_SYMBOL_GPL(sched_plugin_info_key);
+EXPORT_SYMBOL_GPL(sched_plugin_debug_key);
+EXPORT_SYMBOL_GPL(sched_plugin_event_key);
+EXPORT_SYMBOL_GPL(__sched_plugin_event);
+EXPORT_TRACEPOINT_SYMBOL_GPL(sched_plugin_tick);
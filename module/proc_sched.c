@@ -1,129 +1,425 @@
 /* Process Scheduler Module dealing with execution of custom scheduler */
 
+#include <linux/cpumask.h>
 #include <linux/errno.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/string.h>
 #include <linux/time.h>
+#include <linux/version.h>
 #include <linux/workqueue.h>
 
+#include "sched_plugin.h"
+#include "sched_plugin_trace.h"
+
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
 MODULE_DESCRIPTION("Process scheduler module");
 MODULE_LICENSE("GPL");
 
-#define ALL_REG_PIDS (-100)
+/* Shortest accepted time quantum, in microseconds */
+#define MIN_QUANTUM_US 50
 
-/* Enumeration for Process States */
-enum process_state {
-    S_CREATED = 0,   /* Process in Created State */
-    S_RUNNING = 1,   /* Process in Running State */
-    S_WAITING = 2,   /* Process in Waiting State */
-    S_BLOCKED = 3,   /* Process in Blocked State */
-    S_TERMINATED = 4 /* Process in Terminate State */
-};
+/* Shortest accepted minimum granularity, in microseconds */
+#define MIN_GRANULARITY_US MIN_QUANTUM_US
 
-extern int add_process_to_queue(int pid);
-extern int remove_process_from_queue(int pid);
-extern int print_process_queue(void);
-extern int change_process_state_in_queue(int pid, int changeState);
-extern int get_first_process_in_queue(void);
-extern int remove_terminated_processes_from_queue(void);
+/* Scheduler state of a CPU owning a run queue. The hrtimer expires in hard
+ * interrupt context and only queues the work doing the actual switch.
+ */
+struct sched_cpu {
+    struct hrtimer timer;    /* Tick of this CPU */
+    struct hrtimer warn;     /* Lead time warning of the running process */
+    struct work_struct work; /* Context switch deferred out of the timer */
+    ktime_t intended;        /* Time the pending switch was due at */
+    u64 nr_slips;            /* Number of switches measured */
+    u64 slip_sum_ns;         /* Sum of actual minus intended switch times */
+    u64 slip_max_ns;         /* Largest slip seen */
+    int cpu;                 /* CPU the tick switches processes on */
+    int current_pid;         /* Process currently running on the CPU */
+    int tick_stopped;        /* No tick armed, nothing to switch */
+    u64 nr_rounds;           /* Waiting processes given the CPU */
+    u64 wait_sum_ns;         /* Sum of the time they waited for it */
+    u64 wait_max_ns;         /* Longest of those waits */
+    u64 nr_over;             /* Waits longer than the target latency */
+};
 
 static void context_switch(struct work_struct *w);
-static int static_round_robin_scheduling(void);
+static int schedule_cpu(struct sched_cpu *sc);
+static void resched_cpu(int cpu);
+static void kick_cpu(int cpu);
 
 static int flag = 0;
 
-/* Time Quantum storage variable for preemptive schedulers */
+/* Time Quantum storage variable for preemptive schedulers, in seconds */
 static int time_quantum = 3;
 
-static int current_pid = -1;
+/* Time quantum in microseconds, overrides time_quantum when set */
+static int quantum_us;
+
+/* Target scheduling latency in microseconds, the period within which every
+ * runnable process of a CPU should get the CPU once. 0 keeps the fixed
+ * quantum, otherwise the slice of each round is derived from it.
+ */
+static int latency_us;
+
+/* Shortest slice handed out under a target latency, in microseconds */
+static int min_granularity_us = 750;
+
+static DEFINE_PER_CPU(struct sched_cpu, sched_cpus);
 
 struct workqueue_struct *scheduler_wq;
 
-/* Create a delayed_work object with the provided function handler */
-static DECLARE_DELAYED_WORK(scheduler_hdlr, context_switch);
+/* length of a time quantum in nanoseconds */
+static u64 quantum_ns(void)
+{
+    int us = READ_ONCE(quantum_us);
 
-/* switch the currently executing process with another process.
- * It internally calls the provided scheduling policy.
+    if (us)
+        return (u64) us * NSEC_PER_USEC;
+    return (u64) time_quantum * NSEC_PER_SEC;
+}
+
+/* Length of the next slice of a CPU in nanoseconds. Under a target latency
+ * the latency is shared among the runnable processes in proportion to their
+ * weights, the running one getting its share; with too many of them for the
+ * target, the period stretches to give each the minimum granularity.
  */
-static void context_switch(struct work_struct *w)
+static u64 slice_ns(struct sched_cpu *sc)
 {
-    /* Boolean status of the queue */
-    bool q_status = false;
+    int latency = READ_ONCE(latency_us);
+    u64 gran = (u64) READ_ONCE(min_granularity_us) * NSEC_PER_USEC;
+    struct sched_plugin_load load;
+    u64 period, slice;
+
+    if (!latency)
+        return quantum_ns();
+
+    process_queue_load(sc->cpu, &load);
+    if (load.nr_running <= 1 || !load.curr_weight)
+        return max_t(u64, (u64) latency * NSEC_PER_USEC, gran);
+
+    period = max_t(u64, (u64) latency * NSEC_PER_USEC,
+                   load.nr_running * gran);
+    slice = div64_u64(period * load.curr_weight, load.weight);
+    return max(slice, gran);
+}
 
-    printk(KERN_ALERT "Scheduler instance: Context Switch\n");
+/* Arm the tick of a CPU to expire one slice from now. A running process
+ * asking for it through its notification file is warned its lead time
+ * before, should the slice be longer.
+ */
+static void start_tick(struct sched_cpu *sc)
+{
+    u64 slice = slice_ns(sc);
+    u64 lead = process_queue_notify_lead(READ_ONCE(sc->current_pid));
 
-    /* Invoking the static round robin scheduling policy */
-    static_round_robin_scheduling();
+    hrtimer_start(&sc->timer, ns_to_ktime(slice), HRTIMER_MODE_REL);
+    if (lead && lead < slice)
+        hrtimer_start(&sc->warn, ns_to_ktime(slice - lead),
+                      HRTIMER_MODE_REL_SOFT);
+}
 
-    /* Condition check for producer unloading flag set or not */
-    if (flag == 0) {
-        /* Setting the delayed work execution for the provided rate */
-        q_status = queue_delayed_work(scheduler_wq, &scheduler_hdlr,
-                                      time_quantum * HZ);
-    } else
-        printk(KERN_ALERT "Scheduler instance: scheduler is unloading\n");
+/* account the time the process given the CPU last waited for it */
+static void account_latency(struct sched_cpu *sc)
+{
+    u64 target = (u64) READ_ONCE(latency_us) * NSEC_PER_USEC;
+    struct sched_plugin_load load;
+
+    process_queue_load(sc->cpu, &load);
+    if (!load.picked)
+        return;
+    sc->nr_rounds++;
+    sc->wait_sum_ns += load.wait_ns;
+    if (load.wait_ns > sc->wait_max_ns)
+        sc->wait_max_ns = load.wait_ns;
+    if (target && load.wait_ns > target)
+        sc->nr_over++;
 }
 
-static int static_round_robin_scheduling(void)
+/* Stop the tick of a CPU which has nothing to switch, its running process
+ * goes on without being signalled. A process queued meanwhile, seen by the
+ * second check, restarts it; the barrier pairs with the one implied by the
+ * xchg in kick_cpu.
+ */
+static void stop_tick(struct sched_cpu *sc)
 {
-    /* Storage class variable to detecting the process state change */
-    int ret_process_state = -1;
+    WRITE_ONCE(sc->tick_stopped, 1);
+    hrtimer_try_to_cancel(&sc->timer);
+    hrtimer_try_to_cancel(&sc->warn);
+    smp_mb();
+    if (process_queue_need_tick(sc->cpu) && xchg(&sc->tick_stopped, 0))
+        start_tick(sc);
+}
 
-    printk(KERN_INFO "Static Round Robin Scheduling scheme.\n");
+/* tick expiry in hard interrupt context, the switch itself may sleep */
+static enum hrtimer_restart tick_expired(struct hrtimer *timer)
+{
+    struct sched_cpu *sc = container_of(timer, struct sched_cpu, timer);
 
-    /* Removing all terminated process from the queue */
-    remove_terminated_processes_from_queue();
+    sc->intended = hrtimer_get_expires(timer);
+    queue_work(scheduler_wq, &sc->work);
+    return HRTIMER_NORESTART;
+}
 
-    /* Check if the current process id is INVALID or not */
-    if (current_pid != -1) {
-        /* Add the current process to the process queue */
-        add_process_to_queue(current_pid);
-    }
+/* Warning expiry in soft interrupt context, the quantum of the running
+ * process ends within its lead time. Whether it is preempted then is still
+ * up to the policy.
+ */
+static enum hrtimer_restart warn_expired(struct hrtimer *timer)
+{
+    struct sched_cpu *sc = container_of(timer, struct sched_cpu, warn);
 
-    /* Obtaining the first process in the wait queue */
-    current_pid = get_first_process_in_queue();
+    process_queue_notify(READ_ONCE(sc->current_pid), SCHED_NOTIFY_OUT_SOON);
+    return HRTIMER_NORESTART;
+}
 
-    /* Check if the obtained process id is invalid or not. If Invalid
-     * indicates, the queue does not contain any active process.
-     */
-    if (current_pid != -1) {
-        /* Change the process state of the obtained process from queue to
-         * running.
+/* the running process of a CPU exited or blocked, switch right away instead
+ * of idling for the rest of its quantum. Called from the exiting task or in
+ * hard interrupt context.
+ */
+static void resched_cpu(int cpu)
+{
+    struct sched_cpu *sc = per_cpu_ptr(&sched_cpus, cpu);
+
+    if (READ_ONCE(flag))
+        return;
+    sc->intended = ktime_get();
+    queue_work(scheduler_wq, &sc->work);
+}
+
+/* a process was queued on a CPU, restart its tick if it was stopped. An idle
+ * CPU switches right away, a busy one a quantum from now.
+ */
+static void kick_cpu(int cpu)
+{
+    struct sched_cpu *sc = per_cpu_ptr(&sched_cpus, cpu);
+
+    if (READ_ONCE(flag) || !xchg(&sc->tick_stopped, 0))
+        return;
+    if (READ_ONCE(sc->current_pid) == INVALID_PID)
+        resched_cpu(cpu);
+    else
+        start_tick(sc);
+}
+
+/* switch the currently executing process with another process.
+ * It internally calls the provided scheduling policy.
+ */
+static void context_switch(struct work_struct *w)
+{
+    struct sched_cpu *sc = container_of(w, struct sched_cpu, work);
+    u64 slip = ktime_to_ns(ktime_sub(ktime_get(), sc->intended));
+    int prev_pid = sc->current_pid;
+    u64 start;
+
+    /* A warning still pending was meant for a quantum ending early */
+    hrtimer_try_to_cancel(&sc->warn);
+
+    /* Account the timer slip, the actual minus the intended switch time */
+    sc->nr_slips++;
+    sc->slip_sum_ns += slip;
+    if (slip > sc->slip_max_ns)
+        sc->slip_max_ns = slip;
+
+    plugin_debug("Scheduler instance: Context Switch on CPU %d, slip %llu "
+                 "us\n",
+                 sc->cpu, div_u64(slip, NSEC_PER_USEC));
+
+    /* Invoking the active scheduling policy */
+    start = ktime_get_ns();
+    schedule_cpu(sc);
+    trace_sched_plugin_tick(sc->cpu, prev_pid, sc->current_pid, slip,
+                            ktime_get_ns() - start);
+    account_latency(sc);
+
+    /* Condition check for producer unloading flag set or not */
+    if (READ_ONCE(flag) == 0) {
+        /* Setting the next tick one quantum after this switch, a quantum
+         * written at runtime applies from here on. With nothing to switch
+         * to, the tick stops until a process is queued.
          */
-        ret_process_state =
-            change_process_state_in_queue(current_pid, S_RUNNING);
+        if (process_queue_need_tick(sc->cpu)) {
+            WRITE_ONCE(sc->tick_stopped, 0);
+            start_tick(sc);
+        } else {
+            stop_tick(sc);
+        }
+    } else
+        printk(KERN_ALERT "Scheduler instance: scheduler is unloading\n");
+}
 
-        /* Remove the process from the waiting queue */
-        remove_process_from_queue(current_pid);
-    }
+static int schedule_cpu(struct sched_cpu *sc)
+{
+    /* Requeue the current process, reap terminated ones and pick the next
+     * running process of this CPU in a single queue operation. The policy
+     * of the run queue decides whether the current process is preempted.
+     */
+    WRITE_ONCE(sc->current_pid,
+               rotate_process_queue(sc->cpu, sc->current_pid));
 
-    printk(KERN_INFO "Currently running process: %d\n", current_pid);
+    plugin_debug("Currently running process on CPU %d: %d\n", sc->cpu,
+                 sc->current_pid);
 
     /* Check if there no processes active in the scheduler or not */
-    if (current_pid != -1) {
+    if (sc->current_pid != -1 && plugin_debug_enabled()) {
         printk(KERN_INFO "Current Process Queue...\n");
         print_process_queue();
-        printk(KERN_INFO "Currently running process: %d\n", current_pid);
     }
 
     /* success */
     return 0;
 }
 
+static int quantum_show(struct seq_file *m)
+{
+    seq_printf(m, "%llu\n", div_u64(quantum_ns(), NSEC_PER_USEC));
+    return 0;
+}
+
+static int quantum_store(const char *buf)
+{
+    int val, ret = kstrtoint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    if (val < MIN_QUANTUM_US)
+        return -EINVAL;
+    WRITE_ONCE(quantum_us, val);
+    return 0;
+}
+
+static int latency_show(struct seq_file *m)
+{
+    seq_printf(m, "%d\n", READ_ONCE(latency_us));
+    return 0;
+}
+
+/* 0 goes back to the fixed quantum */
+static int latency_store(const char *buf)
+{
+    int val, ret = kstrtoint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    if (val < 0 || (val && val < MIN_QUANTUM_US))
+        return -EINVAL;
+    WRITE_ONCE(latency_us, val);
+    return 0;
+}
+
+static int min_granularity_show(struct seq_file *m)
+{
+    seq_printf(m, "%d\n", READ_ONCE(min_granularity_us));
+    return 0;
+}
+
+static int min_granularity_store(const char *buf)
+{
+    int val, ret = kstrtoint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    if (val < MIN_GRANULARITY_US)
+        return -EINVAL;
+    WRITE_ONCE(min_granularity_us, val);
+    return 0;
+}
+
+/* Achieved scheduling latency per CPU: how long the processes given the CPU
+ * waited for it, against the target latency, and how late the timer fired
+ * the switches. The counters are updated by the switches of each CPU
+ * without locking, a read is only a snapshot.
+ */
+static int latency_stats_show(struct seq_file *m)
+{
+    struct sched_cpu *sc;
+    int cpu;
+
+    seq_printf(m, "target %d us\n", READ_ONCE(latency_us));
+    seq_printf(m, "%-5s %-10s %-12s %-12s %-10s %-12s %-12s\n", "cpu",
+               "rounds", "avg_wait_us", "max_wait_us", "over", "avg_slip_us",
+               "max_slip_us");
+    for_each_cpu (cpu, process_queue_cpumask()) {
+        sc = per_cpu_ptr(&sched_cpus, cpu);
+        seq_printf(m, "%-5d %-10llu %-12llu %-12llu %-10llu %-12llu %-12llu\n",
+                   cpu, sc->nr_rounds,
+                   sc->nr_rounds ? div64_u64(sc->wait_sum_ns,
+                                             sc->nr_rounds * NSEC_PER_USEC)
+                                 : 0,
+                   div_u64(sc->wait_max_ns, NSEC_PER_USEC), sc->nr_over,
+                   sc->nr_slips ? div64_u64(sc->slip_sum_ns,
+                                            sc->nr_slips * NSEC_PER_USEC)
+                                : 0,
+                   div_u64(sc->slip_max_ns, NSEC_PER_USEC));
+    }
+    return 0;
+}
+
+/* writing 0 starts a new measurement */
+static int latency_stats_store(const char *buf)
+{
+    struct sched_cpu *sc;
+    int cpu, val, ret = kstrtoint(buf, 10, &val);
+
+    if (ret)
+        return ret;
+    if (val)
+        return -EINVAL;
+    for_each_cpu (cpu, process_queue_cpumask()) {
+        sc = per_cpu_ptr(&sched_cpus, cpu);
+        sc->nr_rounds = 0;
+        sc->wait_sum_ns = 0;
+        sc->wait_max_ns = 0;
+        sc->nr_over = 0;
+        sc->nr_slips = 0;
+        sc->slip_sum_ns = 0;
+        sc->slip_max_ns = 0;
+    }
+    return 0;
+}
+
+static const struct sched_plugin_tunable sched_tunables[] = {
+    {.name = "quantum", .show = quantum_show, .store = quantum_store},
+    {.name = "latency", .show = latency_show, .store = latency_store},
+    {.name = "min_granularity",
+     .show = min_granularity_show,
+     .store = min_granularity_store},
+    {.name = "latency_stats",
+     .show = latency_stats_show,
+     .store = latency_stats_store},
+};
+
 static int __init process_scheduler_module_init(void)
 {
-    bool q_status = false;
+    struct sched_cpu *sc;
+    int cpu, i;
 
     printk(KERN_INFO "Process Scheduler module is being loaded.\n");
 
-    scheduler_wq = alloc_workqueue("scheduler-wq", WQ_UNBOUND, 1);
+    if (quantum_us < 0 || time_quantum < 0 ||
+        quantum_ns() < MIN_QUANTUM_US * NSEC_PER_USEC) {
+        printk(KERN_ERR "Scheduler instance ERROR: quantum below %d us\n",
+               MIN_QUANTUM_US);
+        return -EINVAL;
+    }
+    if (latency_us < 0 || (latency_us && latency_us < MIN_QUANTUM_US) ||
+        min_granularity_us < MIN_GRANULARITY_US) {
+        printk(KERN_ERR "Scheduler instance ERROR: latency or granularity "
+                        "below %d us\n",
+               MIN_QUANTUM_US);
+        return -EINVAL;
+    }
+
+    /* One tick per CPU, they may run concurrently */
+    scheduler_wq = alloc_workqueue("scheduler-wq", WQ_UNBOUND, 0);
 
     if (scheduler_wq == NULL) {
         printk(KERN_ERR
@@ -132,20 +428,81 @@ static int __init process_scheduler_module_init(void)
         return -ENOMEM;
     }
 
-    /* Performing an internal call for context_switch */
-    /** Setting the delayed work execution for the provided rate */
-    q_status =
-        queue_delayed_work(scheduler_wq, &scheduler_hdlr, time_quantum * HZ);
+    /* Runtime tunables under /proc/sched_plugin */
+    for (i = 0; i < ARRAY_SIZE(sched_tunables); i++) {
+        if (sched_plugin_add_tunable(&sched_tunables[i])) {
+            while (i--)
+                sched_plugin_remove_tunable(&sched_tunables[i]);
+            destroy_workqueue(scheduler_wq);
+            return -ENOMEM;
+        }
+    }
+
+    /* Performing an internal call for context_switch on every CPU owning a
+     * run queue.
+     */
+    for_each_cpu (cpu, process_queue_cpumask()) {
+        sc = per_cpu_ptr(&sched_cpus, cpu);
+        sc->cpu = cpu;
+        sc->current_pid = -1;
+        sc->tick_stopped = 0;
+        sc->nr_rounds = 0;
+        sc->wait_sum_ns = 0;
+        sc->wait_max_ns = 0;
+        sc->nr_over = 0;
+        INIT_WORK(&sc->work, context_switch);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+        hrtimer_setup(&sc->timer, tick_expired, CLOCK_MONOTONIC,
+                      HRTIMER_MODE_REL);
+        hrtimer_setup(&sc->warn, warn_expired, CLOCK_MONOTONIC,
+                      HRTIMER_MODE_REL_SOFT);
+#else
+        hrtimer_init(&sc->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+        sc->timer.function = tick_expired;
+        hrtimer_init(&sc->warn, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+        sc->warn.function = warn_expired;
+#endif
+        /** Setting the first tick for the provided rate */
+        start_tick(sc);
+    }
+
+    process_queue_set_resched(resched_cpu);
+    process_queue_set_kick(kick_cpu);
     return 0;
 }
 
 static void __exit process_scheduler_module_cleanup(void)
 {
+    struct sched_cpu *sc;
+    int cpu, i;
+
+    for (i = 0; i < ARRAY_SIZE(sched_tunables); i++)
+        sched_plugin_remove_tunable(&sched_tunables[i]);
+
     /* Signalling the scheduler module unloading */
-    flag = 1;
+    WRITE_ONCE(flag, 1);
+    process_queue_set_resched(NULL);
+    process_queue_set_kick(NULL);
 
-    /* Cancelling pending jobs in the Work Queue */
-    cancel_delayed_work(&scheduler_hdlr);
+    /* Cancelling the ticks and the pending switches. A switch already running
+     * may have armed its tick again, whose expiry may in turn have queued one
+     * last switch, hence the second round.
+     */
+    for_each_cpu (cpu, process_queue_cpumask()) {
+        sc = per_cpu_ptr(&sched_cpus, cpu);
+        hrtimer_cancel(&sc->timer);
+        cancel_work_sync(&sc->work);
+        hrtimer_cancel(&sc->timer);
+        cancel_work_sync(&sc->work);
+        hrtimer_cancel(&sc->warn);
+        if (sc->nr_slips)
+            printk(KERN_INFO
+                   "Scheduler instance: CPU %d timer slip avg %llu us, "
+                   "max %llu us over %llu switches\n",
+                   cpu,
+                   div64_u64(sc->slip_sum_ns, sc->nr_slips * NSEC_PER_USEC),
+                   div_u64(sc->slip_max_ns, NSEC_PER_USEC), sc->nr_slips);
+    }
 
     /* Removing all the pending jobs from the Work Queue */
     flush_workqueue(scheduler_wq);
@@ -158,3 +515,9 @@ static void __exit process_scheduler_module_cleanup(void)
 module_init(process_scheduler_module_init);
 module_exit(process_scheduler_module_cleanup);
 module_param(time_quantum, int, 0);
+module_param(quantum_us, int, 0);
+MODULE_PARM_DESC(quantum_us, "Time quantum in microseconds");
+module_param(latency_us, int, 0);
+MODULE_PARM_DESC(latency_us, "Target scheduling latency in microseconds");
+module_param(min_granularity_us, int, 0);
+MODULE_PARM_DESC(min_granularity_us, "Shortest slice in microseconds");
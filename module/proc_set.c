@@ -7,15 +7,17 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/pid.h>
 #include <linux/proc_fs.h>
+#include <linux/sched/signal.h>
 #include <linux/slab.h>
+#include <linux/string.h>
 #include <linux/time.h>
-#include <linux/version.h>
+#include <linux/uaccess.h>
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
-#define HAVE_PROC_OPS
-#endif
+#include "sched_plugin.h"
 
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
 MODULE_DESCRIPTION("Process setting module");
@@ -23,15 +25,8 @@ MODULE_LICENSE("GPL");
 
 #define PROC_CONFIG_FILE_NAME "process_sched_add"
 #define BASE_10 (10)
-
-/* Enumeration for Process States */
-enum process_state {
-    S_CREATED = 0,   /**Process in Created State*/
-    S_RUNNING = 1,   /**Process in Running State*/
-    S_WAITING = 2,   /**Process in Waiting State*/
-    S_BLOCKING = 3,  /**Process in Blocked State*/
-    S_TERMINATED = 4 /**Process in Terminate State*/
-};
+/* Longest write accepted, a batch of registrations */
+#define PROC_SET_BUF_SIZE (4 * PAGE_SIZE)
 
 /* Enumeration for Function Execution */
 enum execution {
@@ -41,44 +36,217 @@ enum execution {
 
 static struct proc_dir_entry *proc_sched_add_file_entry;
 
-extern int add_process_to_queue(int pid);
-extern int remove_process_from_queue(int pid);
-extern int print_process_queue(void);
-extern int get_first_process_in_queue(void);
-extern int remove_terminated_processes_from_queue(void);
-extern int change_process_state_in_queue(int pid, int changeState);
-
 static ssize_t process_sched_add_module_read(struct file *file,
                                              char *buf,
                                              size_t count,
                                              loff_t *ppos)
 {
-    printk(KERN_INFO "Process Scheduler Add Module read.\n");
-    printk(KERN_INFO "Next Executable PID in the list if RR Scheduling: %d\n",
-           get_first_process_in_queue());
+    plugin_debug("Process Scheduler Add Module read.\n");
+    plugin_info("Next Executable PID in the list if RR Scheduling: %d\n",
+                get_first_process_in_queue());
     /* Successful execution of read call back. EOF reached */
     return 0;
 }
 
-static ssize_t process_sched_add_module_write(struct file *file,
-                                              const char *buf,
-                                              size_t count,
-                                              loff_t *ppos)
+/* parse a time given in microseconds into nanoseconds */
+static int parse_usecs(const char *val, u64 *ns)
+{
+    u64 us;
+    int ret = kstrtou64(val, BASE_10, &us);
+
+    if (ret)
+        return ret;
+    if (us > div_u64(U64_MAX, NSEC_PER_USEC))
+        return -ERANGE;
+    *ns = us * NSEC_PER_USEC;
+    return 0;
+}
+
+/* parse a ticket transfer "pid:tickets" */
+static int parse_transfer(char *val, int *to, unsigned int *tickets)
+{
+    char *pid = strsep(&val, ":");
+
+    if (!val || kstrtoint(pid, BASE_10, to))
+        return -EINVAL;
+    return kstrtouint(val, BASE_10, tickets);
+}
+
+/* parse one registration "pid[,key=value...]", the keys being the
+ * scheduling attributes: weight, prio, tickets and the reservation runtime,
+ * deadline and period in microseconds. "transfer=pid:tickets" gives tickets
+ * to another registered process, *to is left INVALID_PID without one.
+ */
+static int parse_registration(char *str,
+                              int *pid,
+                              struct sched_plugin_attr *attr,
+                              int *to,
+                              unsigned int *tickets)
 {
+    char *tok, *val;
     int ret;
-    long int new_proc_id;
 
-    printk(KERN_INFO "Process Scheduler Add Module write.\n");
-    printk(KERN_INFO "Registered Process ID: %s\n", buf);
+    memset(attr, 0, sizeof(*attr));
+    *to = INVALID_PID;
+    tok = strsep(&str, ",");
+    if (kstrtoint(tok, BASE_10, pid))
+        return -EINVAL;
+
+    while ((tok = strsep(&str, ","))) {
+        val = strchr(tok, '=');
+        if (!val)
+            return -EINVAL;
+        *val++ = '\0';
+        if (!strcmp(tok, "weight")) {
+            ret = kstrtouint(val, BASE_10, &attr->weight);
+            attr->set |= SCHED_ATTR_WEIGHT;
+        } else if (!strcmp(tok, "prio")) {
+            ret = kstrtoint(val, BASE_10, &attr->prio);
+            attr->set |= SCHED_ATTR_PRIO;
+        } else if (!strcmp(tok, "tickets")) {
+            ret = kstrtouint(val, BASE_10, &attr->tickets);
+            attr->set |= SCHED_ATTR_TICKETS;
+        } else if (!strcmp(tok, "transfer")) {
+            ret = parse_transfer(val, to, tickets);
+        } else if (!strcmp(tok, "runtime")) {
+            ret = parse_usecs(val, &attr->runtime);
+            attr->set |= SCHED_ATTR_RUNTIME;
+        } else if (!strcmp(tok, "deadline")) {
+            ret = parse_usecs(val, &attr->deadline);
+            attr->set |= SCHED_ATTR_DEADLINE;
+        } else if (!strcmp(tok, "period")) {
+            ret = parse_usecs(val, &attr->period);
+            attr->set |= SCHED_ATTR_PERIOD;
+        } else {
+            return -EINVAL;
+        }
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
 
-    ret = kstrtol(buf, BASE_10, &new_proc_id);
-    if (ret < 0) {
-        /* Invalid argument in conversion error */
+/* Registrations without attributes collected from one write, flushed as a
+ * single batch
+ */
+struct pid_batch {
+    int *pids;
+    int nr, cap;
+};
+
+static int batch_add(struct pid_batch *b, int pid)
+{
+    int *pids, cap = b->cap ? b->cap * 2 : 64;
+
+    if (b->nr == b->cap) {
+        pids = krealloc(b->pids, cap * sizeof(*pids), GFP_KERNEL);
+        if (!pids)
+            return -ENOMEM;
+        b->pids = pids;
+        b->cap = cap;
+    }
+    b->pids[b->nr++] = pid;
+    return 0;
+}
+
+/* register the collected PIDs, keeping the first error of the write */
+static void batch_flush(struct pid_batch *b, int *err)
+{
+    int ret = add_processes_to_queue(b->pids, b->nr);
+
+    if (ret && !*err)
+        *err = ret;
+    b->nr = 0;
+}
+
+/* Thread IDs of every thread of a process, as seen from the writer. Threads
+ * created while this runs may be missed.
+ */
+static int thread_group_pids(int tgid, int **pids)
+{
+    struct task_struct *task, *t;
+    int nr = 0, cap;
+
+    rcu_read_lock();
+    task = pid_task(find_vpid(tgid), PIDTYPE_TGID);
+    cap = task ? get_nr_threads(task) : 0;
+    rcu_read_unlock();
+    if (!cap)
+        return -ESRCH;
+
+    *pids = kmalloc_array(cap, sizeof(**pids), GFP_KERNEL);
+    if (!*pids)
+        return -ENOMEM;
+
+    rcu_read_lock();
+    task = pid_task(find_vpid(tgid), PIDTYPE_TGID);
+    if (task) {
+        for_each_thread (task, t) {
+            if (nr == cap)
+                break;
+            (*pids)[nr++] = task_pid_vnr(t);
+        }
+    }
+    rcu_read_unlock();
+    if (!nr) {
+        kfree(*pids);
+        return -ESRCH;
+    }
+    return nr;
+}
+
+/* Apply one token of a write: "pid[,key=value...]" registers a process,
+ * "tgid:pid" every thread of a process and "-pid" or "-tgid:pid" removes
+ * them again. Registrations without attributes are only collected into the
+ * batch, anything else flushes it first so that the tokens apply in order.
+ */
+static int apply_token(char *tok, struct pid_batch *b, int *err)
+{
+    struct sched_plugin_attr attr;
+    bool remove = *tok == '-';
+    int i, nr, pid, to, ret;
+    unsigned int tickets;
+    int *pids;
+
+    if (remove)
+        tok++;
+
+    if (!strncmp(tok, "tgid:", 5)) {
+        if (kstrtoint(tok + 5, BASE_10, &pid))
+            return -EINVAL;
+        nr = thread_group_pids(pid, &pids);
+        if (nr < 0)
+            return nr;
+        ret = 0;
+        if (remove) {
+            batch_flush(b, err);
+            for (i = 0; i < nr; i++)
+                remove_process_from_queue(pids[i]);
+        } else {
+            for (i = 0; i < nr && !ret; i++)
+                ret = batch_add(b, pids[i]);
+        }
+        kfree(pids);
+        return ret;
+    }
+
+    ret = parse_registration(tok, &pid, &attr, &to, &tickets);
+    if (ret)
         return -EINVAL;
+    if (remove) {
+        if (attr.set || to != INVALID_PID)
+            return -EINVAL;
+        batch_flush(b, err);
+        return remove_process_from_queue(pid);
     }
+    if (!attr.set && to == INVALID_PID)
+        return batch_add(b, pid);
 
-    /* Add process to the process queue */
-    ret = add_process_to_queue(new_proc_id);
+    /* Add process to the process queue, a registered one only gets its
+     * attributes updated
+     */
+    batch_flush(b, err);
+    ret = add_process_to_queue(pid, attr.set ? &attr : NULL);
 
     /* Check if the add process to queue method was successful */
     if (ret != EC_SUCCESS) {
@@ -86,16 +254,57 @@ static ssize_t process_sched_add_module_write(struct file *file,
                "Process Set ERROR:add_process_to_queue function failed from "
                "sched set write method");
         /* Add process to queue error */
-        return -ENOMEM;
+        return ret;
     }
 
+    plugin_info("Registered Process ID: %d\n", pid);
+
+    /* Tickets are transferred once the giver is registered */
+    if (to != INVALID_PID)
+        return transfer_process_tickets(pid, to, tickets);
+    return 0;
+}
+
+/* A write holds one or more tokens separated by white space. They are all
+ * applied even if one fails, the write then fails with the first error.
+ */
+static ssize_t process_sched_add_module_write(struct file *file,
+                                              const char __user *ubuf,
+                                              size_t count,
+                                              loff_t *ppos)
+{
+    struct pid_batch batch = {};
+    char *buf, *str, *tok;
+    int ret, err = 0;
+
+    plugin_debug("Process Scheduler Add Module write.\n");
+
+    if (count > PROC_SET_BUF_SIZE)
+        return -EINVAL;
+    buf = memdup_user_nul(ubuf, count);
+    if (IS_ERR(buf))
+        return PTR_ERR(buf);
+
+    str = buf;
+    while ((tok = strsep(&str, " \t\n"))) {
+        if (!*tok)
+            continue;
+        ret = apply_token(tok, &batch, &err);
+        if (ret && !err)
+            err = ret;
+    }
+    batch_flush(&batch, &err);
+
+    kfree(batch.pids);
+    kfree(buf);
+
     /* Successful execution of write call back */
-    return count;
+    return err ? err : count;
 }
 
 static int process_sched_add_module_open(struct inode *inode, struct file *file)
 {
-    printk(KERN_INFO "Process Scheduler Add Module open.\n");
+    plugin_debug("Process Scheduler Add Module open.\n");
 
     /** Successful execution of open call back.*/
     return 0;
@@ -104,7 +313,7 @@ static int process_sched_add_module_open(struct inode *inode, struct file *file)
 static int process_sched_add_module_release(struct inode *inode,
                                             struct file *file)
 {
-    printk(KERN_INFO "Process Scheduler Add Module released.\n");
+    plugin_debug("Process Scheduler Add Module released.\n");
     /* Successful execution of release callback */
     return 0;
 }
@@ -131,8 +340,8 @@ static int __init process_sched_add_module_init(void)
 {
     printk(KERN_INFO "Process Add to Scheduler module is being loaded.\n");
 
-    /* created with RD + WR permissions with name process_sched_add */
-    proc_sched_add_file_entry = proc_create(PROC_CONFIG_FILE_NAME, 0777, NULL,
+    /* created with name process_sched_add, writable by root only */
+    proc_sched_add_file_entry = proc_create(PROC_CONFIG_FILE_NAME, 0644, NULL,
                                             &process_sched_add_module_fops);
     /* Condition to verify if process_sched_add creation was successful */
     if (proc_sched_add_file_entry == NULL) {
@@ -0,0 +1,244 @@
+/* Definitions shared by the process queue, scheduler and setting modules */
+
+#ifndef SCHED_PLUGIN_H
+#define SCHED_PLUGIN_H
+
+#include <linux/cpumask.h>
+#include <linux/jump_label.h>
+#include <linux/list.h>
+#include <linux/printk.h>
+#include <linux/proc_fs.h>
+#include <linux/rbtree.h>
+#include <linux/seq_file.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define HAVE_PROC_OPS
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 17, 0)
+#define pde_data PDE_DATA
+#endif
+
+#define ALL_REG_PIDS (-100)
+#define INVALID_PID (-1)
+
+/* Enumeration for Process States */
+enum process_state {
+    S_CREATED = 0,   /* Process in Created State */
+    S_RUNNING = 1,   /* Process in Running State */
+    S_WAITING = 2,   /* Process in Waiting State */
+    S_BLOCKING = 3,  /* Process in Blocked State */
+    S_TERMINATED = 4 /* Process in Terminate State */
+};
+
+/* Enumeration for the logging levels of /proc/sched_plugin/log_level */
+enum sched_log_level {
+    SCHED_LOG_ERR = 0,  /* Errors only */
+    SCHED_LOG_INFO = 1, /* Registration and removal of processes */
+    SCHED_LOG_DEBUG = 2 /* Every context switch and state change */
+};
+
+extern int sched_plugin_log_level;
+
+/* Static keys following the logging level and the event tunable, so that
+ * logging and tracing cost a patched out jump while off
+ */
+DECLARE_STATIC_KEY_FALSE(sched_plugin_info_key);
+DECLARE_STATIC_KEY_FALSE(sched_plugin_debug_key);
+DECLARE_STATIC_KEY_FALSE(sched_plugin_event_key);
+
+#define plugin_info_enabled() static_branch_unlikely(&sched_plugin_info_key)
+#define plugin_debug_enabled() static_branch_unlikely(&sched_plugin_debug_key)
+
+#define plugin_info(fmt, ...)                      \
+    do {                                           \
+        if (plugin_info_enabled())                 \
+            printk(KERN_INFO fmt, ##__VA_ARGS__);  \
+    } while (0)
+
+#define plugin_debug(fmt, ...)                     \
+    do {                                           \
+        if (plugin_debug_enabled())                \
+            printk(KERN_INFO fmt, ##__VA_ARGS__);  \
+    } while (0)
+
+/* Enumeration for the events recorded in the debugfs event ring */
+enum sched_plugin_event_type {
+    EV_REGISTER = 0, /* Process registered, arg is its CPU */
+    EV_REMOVE = 1,   /* Process removed */
+    EV_EXIT = 2,     /* Registered task exited, arg is its CPU */
+    EV_SWITCH = 3,   /* Process given the CPU, arg is the outgoing PID */
+    EV_BLOCK = 4,    /* Running process blocked, arg is its CPU */
+    EV_STATE = 5,    /* Task suspended or resumed, arg is the new state */
+    EV_MIGRATE = 6,  /* Process stolen, arg is the CPU it left */
+    EV_NR_TYPES
+};
+
+void __sched_plugin_event(enum sched_plugin_event_type type, int pid, int arg);
+
+#define plugin_event_enabled() static_branch_unlikely(&sched_plugin_event_key)
+
+#define plugin_event(type, pid, arg)               \
+    do {                                           \
+        if (plugin_event_enabled())                \
+            __sched_plugin_event(type, pid, arg);  \
+    } while (0)
+
+/* Runtime tunable exposed as /proc/sched_plugin/<name> */
+struct sched_plugin_tunable {
+    const char *name;                /* File name in /proc/sched_plugin */
+    int (*show)(struct seq_file *m); /* Print the current value */
+    int (*store)(const char *buf);   /* Parse and apply a new value */
+};
+
+int sched_plugin_add_tunable(const struct sched_plugin_tunable *tunable);
+void sched_plugin_remove_tunable(const struct sched_plugin_tunable *tunable);
+
+/* Enumeration for the ways of keeping a waiting process off its CPU */
+enum sched_plugin_suspend {
+    SUSPEND_SIGNAL = 0, /* SIGSTOP and SIGCONT to the thread group */
+    SUSPEND_IDLE = 1    /* SCHED_IDLE while waiting, nice -20 while running */
+};
+
+/* Weight of a process registered without one and the accepted range */
+#define SCHED_PLUGIN_WEIGHT_DEFAULT 1024
+#define SCHED_PLUGIN_WEIGHT_MIN 1
+#define SCHED_PLUGIN_WEIGHT_MAX 65536
+
+/* Priority levels, 0 being the highest, and the level of a process registered
+ * without one
+ */
+#define SCHED_PLUGIN_NR_PRIO 40
+#define SCHED_PLUGIN_PRIO_DEFAULT 20
+
+/* Lottery tickets of a process registered without any and the accepted
+ * range
+ */
+#define SCHED_PLUGIN_TICKETS_DEFAULT 100
+#define SCHED_PLUGIN_TICKETS_MIN 1
+#define SCHED_PLUGIN_TICKETS_MAX (1U << 20)
+
+/* Fixed point shift of the CPU bandwidth of a reservation, runtime/period */
+#define SCHED_PLUGIN_BW_SHIFT 20
+
+/* Scheduling attributes given as "key=value" at registration or later, only
+ * the ones flagged in set are applied. A reservation of runtime every period
+ * is given as a whole, a period of zero drops it.
+ */
+struct sched_plugin_attr {
+    unsigned int set;     /* Attributes given, SCHED_ATTR_* flags */
+    unsigned int weight;  /* Share of the CPU relative to other processes */
+    int prio;             /* Priority level, 0 the highest */
+    unsigned int tickets; /* Lottery tickets held */
+    u64 runtime;          /* CPU time reserved every period, ns */
+    u64 deadline;         /* Deadline relative to the period start, ns */
+    u64 period;           /* Period of the reservation, ns */
+};
+
+#define SCHED_ATTR_WEIGHT (1U << 0)
+#define SCHED_ATTR_PRIO (1U << 1)
+#define SCHED_ATTR_RUNTIME (1U << 2)
+#define SCHED_ATTR_DEADLINE (1U << 3)
+#define SCHED_ATTR_PERIOD (1U << 4)
+#define SCHED_ATTR_TICKETS (1U << 5)
+#define SCHED_ATTR_RESERVATION \
+    (SCHED_ATTR_RUNTIME | SCHED_ATTR_DEADLINE | SCHED_ATTR_PERIOD)
+
+/* Scheduling entity of a registered process, handed to the policies. The
+ * run time fields are kept up to date by proc_queue: they are set when the
+ * process is given the CPU and refreshed before every tick of the policy.
+ */
+struct sched_plugin_task {
+    struct list_head run_list; /* Link into a list of a policy run queue */
+    struct rb_node run_node;   /* Link into a tree of a policy run queue */
+    u64 exec_start;            /* Time the process was last given the CPU */
+    u64 sum_exec_runtime;      /* CPU time consumed by the task */
+    u64 prev_sum_exec_runtime; /* sum_exec_runtime when given the CPU */
+    u64 delta_exec;            /* CPU time consumed since the last tick */
+    u64 wait_start;            /* Time the process last had to wait */
+    u64 vruntime;              /* Run time scaled by the inverse weight */
+    unsigned int weight;       /* Share of the CPU, "weight" attribute */
+    int prio;                  /* Priority level, "prio" attribute */
+    int level;                 /* Feedback queue level, 0 the highest */
+    unsigned int slice_ticks;  /* Ticks run in the current slice */
+    bool sleeping;             /* Found asleep when last switched or picked */
+    u64 dl_runtime;            /* Reserved CPU time per period, ns */
+    u64 dl_deadline;           /* Relative deadline, ns */
+    u64 dl_period;             /* Period of the reservation, 0 for none */
+    u64 deadline;              /* Absolute deadline of the current job */
+    u64 dl_release;            /* Start of the next period */
+    s64 budget;                /* Reserved CPU time left in this period */
+    bool dl_throttled;         /* Budget used up until dl_release */
+    unsigned long nr_jobs;     /* Periods started */
+    unsigned long nr_missed;   /* Periods whose deadline was missed */
+    unsigned int tickets;      /* Lottery tickets, "tickets" attribute */
+    unsigned int lottery_slot; /* Index into a lottery run queue, 0 if none */
+};
+
+/* Scheduling policy ordering the waiting processes of each run queue. The
+ * per-CPU state of a policy comes from alloc_rq and is passed to every other
+ * callback. All callbacks but alloc_rq and free_rq are called with the run
+ * queue lock held and must not sleep. The running process is never queued.
+ */
+struct sched_plugin_policy {
+    const char *name;                  /* Name in /proc/sched_plugin/policy */
+    enum sched_plugin_suspend suspend; /* Suspension backend of the policy */
+    void *(*alloc_rq)(int cpu);        /* Optional, NULL on failure */
+    void (*free_rq)(void *rq);         /* Optional */
+    /* Queue a waiting process */
+    void (*enqueue)(void *rq, struct sched_plugin_task *t);
+    /* Take a waiting process off the queue */
+    void (*dequeue)(void *rq, struct sched_plugin_task *t);
+    /* Waiting process to run next, left queued. NULL only when none is
+     * waiting, a process must be returned whenever one is queued.
+     */
+    struct sched_plugin_task *(*pick_next)(void *rq);
+    /* Quantum of the running process over, true to preempt it */
+    bool (*tick)(void *rq, struct sched_plugin_task *curr);
+    /* Optional, the process leaves the policy, dequeued already if waiting.
+     * It may never have been queued by this policy.
+     */
+    void (*task_exit)(void *rq, struct sched_plugin_task *t);
+    struct list_head list; /* Link into the registered policies */
+};
+
+/* Enumeration for the events of /proc/sched_plugin/notify */
+enum sched_plugin_notify {
+    SCHED_NOTIFY_IN = 0,       /* Process given the CPU */
+    SCHED_NOTIFY_OUT_SOON = 1, /* Its quantum ends within the lead time */
+    SCHED_NOTIFY_OUT = 2,      /* Process switched out */
+    SCHED_NOTIFY_NR
+};
+
+/* Load of a run queue, from which the scheduler sizes the next slice */
+struct sched_plugin_load {
+    unsigned int nr_running;  /* Processes waiting or running */
+    unsigned long weight;     /* Sum of their weights */
+    unsigned int curr_weight; /* Weight of the running process, 0 if none */
+    bool picked;              /* Last rotation gave the CPU to a waiter */
+    u64 wait_ns;              /* How long that process waited for it */
+};
+
+int sched_plugin_register_policy(struct sched_plugin_policy *policy);
+void sched_plugin_unregister_policy(struct sched_plugin_policy *policy);
+
+/* Interfaces of the process queue module */
+int add_process_to_queue(int pid, const struct sched_plugin_attr *attr);
+int add_processes_to_queue(const int *pids, int nr);
+int transfer_process_tickets(int from, int to, unsigned int tickets);
+int remove_process_from_queue(int pid);
+int print_process_queue(void);
+int change_process_state_in_queue(int pid, int changeState);
+int get_first_process_in_queue(void);
+int remove_terminated_processes_from_queue(void);
+int rotate_process_queue(int cpu, int prev_pid);
+const struct cpumask *process_queue_cpumask(void);
+void process_queue_set_resched(void (*resched)(int cpu));
+void process_queue_set_kick(void (*kick)(int cpu));
+bool process_queue_need_tick(int cpu);
+void process_queue_load(int cpu, struct sched_plugin_load *load);
+void process_queue_notify(int pid, enum sched_plugin_notify event);
+u64 process_queue_notify_lead(int pid);
+
+#endif /* SCHED_PLUGIN_H */
@@ -0,0 +1,62 @@
+/* Layout of /proc/sched_plugin/state, a read-only area user space maps to
+ * follow the scheduler without system calls. Shared by proc_queue and the
+ * reader library in user/, so only fixed size types are used.
+ *
+ * The area starts with a header, followed by one record per possible CPU at
+ * cpu_offset and by nr_slots task records at task_offset. Every record has
+ * its own sequence count: a writer makes it odd before changing the record
+ * and even again afterwards, so a reader copying a record retries while the
+ * count is odd or has changed meanwhile. A task slot whose pid is 0 is free.
+ */
+
+#ifndef SCHED_PLUGIN_STATE_H
+#define SCHED_PLUGIN_STATE_H
+
+#include <linux/types.h>
+
+#define SCHED_STATE_MAGIC 0x53505354 /* "SPST" */
+#define SCHED_STATE_VERSION 1
+
+struct sched_state_header {
+    __u32 magic;        /* SCHED_STATE_MAGIC */
+    __u32 version;      /* SCHED_STATE_VERSION */
+    __u32 size;         /* Bytes of the whole area */
+    __u32 nr_cpus;      /* CPU records, one per possible CPU */
+    __u32 cpu_offset;   /* Offset of the first CPU record */
+    __u32 cpu_size;     /* Size of a CPU record */
+    __u32 nr_slots;     /* Task records */
+    __u32 task_offset;  /* Offset of the first task record */
+    __u32 task_size;    /* Size of a task record */
+    __u32 seq;          /* Sequence count of the fields below */
+    __u32 nr_tasks;     /* Registered processes */
+    __u32 nr_unslotted; /* Registered processes without a task record */
+    __u64 generation;   /* Bumped whenever a task record is taken or freed */
+};
+
+/* Run queue of a CPU, as of its last change */
+struct sched_state_cpu {
+    __u32 seq;             /* Sequence count of the record */
+    __s32 running_pid;     /* Process running on the CPU, -1 for none */
+    __u32 nr_queued;       /* Processes waiting in the run queue */
+    __u32 active;          /* 1 if the CPU owns a run queue */
+    __u64 nr_rotations;    /* Rotations of the run queue */
+    __u64 last_rotation;   /* Time of the last one, CLOCK_MONOTONIC ns */
+    __u64 nr_switches;     /* Rotations giving the CPU to another process */
+    __u64 reserved[3];
+};
+
+/* Registered process */
+struct sched_state_task {
+    __u32 seq;            /* Sequence count of the record */
+    __s32 pid;            /* Process ID, 0 for a free slot */
+    __s32 tgid;           /* Thread group, 0 for none */
+    __s32 cpu;            /* CPU of its run queue */
+    __u32 state;          /* enum process_state of sched_plugin.h */
+    __u32 reserved;
+    __u64 run_ns;         /* Time given the CPU, up to the last switch */
+    __u64 wait_ns;        /* Time spent waiting for the CPU */
+    __u64 nr_scheduled;   /* Times given the CPU */
+    __u64 nr_involuntary; /* Times preempted while runnable */
+};
+
+#endif /* SCHED_PLUGIN_STATE_H */
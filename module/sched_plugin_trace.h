@@ -0,0 +1,180 @@
+/* Tracepoints of the scheduler plugin, under events/sched_plugin/ of ftrace
+ * and usable from perf and trace-cmd. They are created in proc_queue and
+ * exported for proc_sched.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sched_plugin
+
+#if !defined(SCHED_PLUGIN_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define SCHED_PLUGIN_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* Enumerations shown by name, resolved for the user space tools too */
+TRACE_DEFINE_ENUM(S_CREATED);
+TRACE_DEFINE_ENUM(S_RUNNING);
+TRACE_DEFINE_ENUM(S_WAITING);
+TRACE_DEFINE_ENUM(S_BLOCKING);
+TRACE_DEFINE_ENUM(S_TERMINATED);
+TRACE_DEFINE_ENUM(SUSPEND_SIGNAL);
+TRACE_DEFINE_ENUM(SUSPEND_IDLE);
+
+#define show_proc_state(state)                                             \
+    __print_symbolic(state, {S_CREATED, "created"}, {S_RUNNING, "running"}, \
+                     {S_WAITING, "waiting"}, {S_BLOCKING, "blocked"},      \
+                     {S_TERMINATED, "terminated"})
+
+/* A process was queued by a registration or removed from its run queue */
+DECLARE_EVENT_CLASS(sched_plugin_queue_template,
+
+    TP_PROTO(int pid, int cpu, unsigned int nr_queued),
+
+    TP_ARGS(pid, cpu, nr_queued),
+
+    TP_STRUCT__entry(
+        __field(int, pid)
+        __field(int, cpu)
+        __field(unsigned int, nr_queued)
+    ),
+
+    TP_fast_assign(
+        __entry->pid = pid;
+        __entry->cpu = cpu;
+        __entry->nr_queued = nr_queued;
+    ),
+
+    TP_printk("pid=%d cpu=%d nr_queued=%u", __entry->pid, __entry->cpu,
+              __entry->nr_queued)
+);
+
+DEFINE_EVENT(sched_plugin_queue_template, sched_plugin_enqueue,
+    TP_PROTO(int pid, int cpu, unsigned int nr_queued),
+    TP_ARGS(pid, cpu, nr_queued));
+
+DEFINE_EVENT(sched_plugin_queue_template, sched_plugin_remove,
+    TP_PROTO(int pid, int cpu, unsigned int nr_queued),
+    TP_ARGS(pid, cpu, nr_queued));
+
+/* A rotation of a run queue picked the next running process, wait_ns being
+ * how long it waited for the CPU
+ */
+TRACE_EVENT(sched_plugin_pick,
+
+    TP_PROTO(int cpu, int prev_pid, int next_pid, unsigned int nr_queued,
+             u64 wait_ns),
+
+    TP_ARGS(cpu, prev_pid, next_pid, nr_queued, wait_ns),
+
+    TP_STRUCT__entry(
+        __field(int, cpu)
+        __field(int, prev_pid)
+        __field(int, next_pid)
+        __field(unsigned int, nr_queued)
+        __field(u64, wait_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu = cpu;
+        __entry->prev_pid = prev_pid;
+        __entry->next_pid = next_pid;
+        __entry->nr_queued = nr_queued;
+        __entry->wait_ns = wait_ns;
+    ),
+
+    TP_printk("cpu=%d prev_pid=%d next_pid=%d nr_queued=%u wait_ns=%llu",
+              __entry->cpu, __entry->prev_pid, __entry->next_pid,
+              __entry->nr_queued, __entry->wait_ns)
+);
+
+/* A registered process changed state in its run queue */
+TRACE_EVENT(sched_plugin_state,
+
+    TP_PROTO(int pid, int old_state, int new_state, unsigned int nr_queued),
+
+    TP_ARGS(pid, old_state, new_state, nr_queued),
+
+    TP_STRUCT__entry(
+        __field(int, pid)
+        __field(int, old_state)
+        __field(int, new_state)
+        __field(unsigned int, nr_queued)
+    ),
+
+    TP_fast_assign(
+        __entry->pid = pid;
+        __entry->old_state = old_state;
+        __entry->new_state = new_state;
+        __entry->nr_queued = nr_queued;
+    ),
+
+    TP_printk("pid=%d old_state=%s new_state=%s nr_queued=%u", __entry->pid,
+              show_proc_state(__entry->old_state),
+              show_proc_state(__entry->new_state), __entry->nr_queued)
+);
+
+/* The task of a process was suspended or resumed by a backend, one of enum
+ * sched_plugin_suspend
+ */
+TRACE_EVENT(sched_plugin_task_status,
+
+    TP_PROTO(int pid, int state, int backend),
+
+    TP_ARGS(pid, state, backend),
+
+    TP_STRUCT__entry(
+        __field(int, pid)
+        __field(int, state)
+        __field(int, backend)
+    ),
+
+    TP_fast_assign(
+        __entry->pid = pid;
+        __entry->state = state;
+        __entry->backend = backend;
+    ),
+
+    TP_printk("pid=%d state=%s backend=%s", __entry->pid,
+              show_proc_state(__entry->state),
+              __print_symbolic(__entry->backend, {SUSPEND_SIGNAL, "signal"},
+                               {SUSPEND_IDLE, "idle"}))
+);
+
+/* One switch of a CPU by the scheduler: how late it ran after its tick was
+ * due and how long the switch itself took
+ */
+TRACE_EVENT(sched_plugin_tick,
+
+    TP_PROTO(int cpu, int prev_pid, int next_pid, u64 slip_ns, u64 cost_ns),
+
+    TP_ARGS(cpu, prev_pid, next_pid, slip_ns, cost_ns),
+
+    TP_STRUCT__entry(
+        __field(int, cpu)
+        __field(int, prev_pid)
+        __field(int, next_pid)
+        __field(u64, slip_ns)
+        __field(u64, cost_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu = cpu;
+        __entry->prev_pid = prev_pid;
+        __entry->next_pid = next_pid;
+        __entry->slip_ns = slip_ns;
+        __entry->cost_ns = cost_ns;
+    ),
+
+    TP_printk("cpu=%d prev_pid=%d next_pid=%d slip_ns=%llu cost_ns=%llu",
+              __entry->cpu, __entry->prev_pid, __entry->next_pid,
+              __entry->slip_ns, __entry->cost_ns)
+);
+
+#endif /* SCHED_PLUGIN_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sched_plugin_trace
+#include <trace/define_trace.h>
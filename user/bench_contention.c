@@ -0,0 +1,157 @@
+/* Contention benchmark of the process queue: many threads read
+ * /proc/process_sched_add while others register PIDs through it. The PIDs
+ * belong to idle children forked for the purpose, registering one again only
+ * walks the locked path of the queue. The children are killed at the end,
+ * which removes them from the queue.
+ *
+ * Usage: bench_contention [readers] [writers] [seconds]
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sched_util.h"
+
+#define PROC_FILE "/proc/process_sched_add"
+#define PIDS_PER_WRITER 16
+
+struct worker {
+    pthread_t thread;
+    int id;
+    unsigned long ops;
+    unsigned long long total_ns, max_ns;
+};
+
+static volatile int stop;
+static pid_t *children;
+
+static void account(struct worker *w, unsigned long long t0)
+{
+    unsigned long long d = now_ns() - t0;
+    w->ops++;
+    w->total_ns += d;
+    if (d > w->max_ns)
+        w->max_ns = d;
+}
+
+static void *reader(void *arg)
+{
+    struct worker *w = arg;
+    char buf[64];
+
+    while (!stop) {
+        unsigned long long t0 = now_ns();
+        int fd = open(PROC_FILE, O_RDONLY);
+        if (fd < 0) {
+            perror(PROC_FILE);
+            break;
+        }
+        if (read(fd, buf, sizeof(buf)) < 0)
+            perror("read");
+        close(fd);
+        account(w, t0);
+    }
+    return NULL;
+}
+
+static void *writer(void *arg)
+{
+    struct worker *w = arg;
+    char buf[32];
+
+    for (unsigned long i = 0; !stop; i++) {
+        int pid = children[w->id * PIDS_PER_WRITER + i % PIDS_PER_WRITER];
+        int len = snprintf(buf, sizeof(buf), "%d", pid);
+        unsigned long long t0 = now_ns();
+        int fd = open(PROC_FILE, O_WRONLY);
+        if (fd < 0) {
+            perror(PROC_FILE);
+            break;
+        }
+        if (write(fd, buf, len) < 0)
+            perror("write");
+        close(fd);
+        account(w, t0);
+    }
+    return NULL;
+}
+
+static void report(const char *role, struct worker *w, int n, int seconds)
+{
+    unsigned long ops = 0;
+    unsigned long long total_ns = 0, max_ns = 0;
+
+    for (int i = 0; i < n; i++) {
+        ops += w[i].ops;
+        total_ns += w[i].total_ns;
+        if (w[i].max_ns > max_ns)
+            max_ns = w[i].max_ns;
+    }
+    printf("%-8s threads=%-3d ops/s=%-10lu avg=%.2fus max=%.2fus\n", role, n,
+           ops / seconds, ops ? total_ns / 1000.0 / ops : 0.0,
+           max_ns / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    int readers = argc > 1 ? atoi(argv[1]) : 8;
+    int writers = argc > 2 ? atoi(argv[2]) : 4;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    struct worker *r, *w;
+
+    if (readers < 0 || writers < 0 || seconds <= 0) {
+        fprintf(stderr, "usage: %s [readers] [writers] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    /* Idle children whose PIDs the writers register */
+    children = calloc(writers * PIDS_PER_WRITER + 1, sizeof(*children));
+    for (int i = 0; i < writers * PIDS_PER_WRITER; i++) {
+        children[i] = fork();
+        if (children[i] < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (children[i] == 0) {
+            for (;;)
+                pause();
+        }
+    }
+
+    r = calloc(readers + 1, sizeof(*r));
+    w = calloc(writers + 1, sizeof(*w));
+    for (int i = 0; i < readers; i++) {
+        r[i].id = i;
+        pthread_create(&r[i].thread, NULL, reader, &r[i]);
+    }
+    for (int i = 0; i < writers; i++) {
+        w[i].id = i;
+        pthread_create(&w[i].thread, NULL, writer, &w[i]);
+    }
+
+    sleep(seconds);
+    stop = 1;
+    for (int i = 0; i < readers; i++)
+        pthread_join(r[i].thread, NULL);
+    for (int i = 0; i < writers; i++)
+        pthread_join(w[i].thread, NULL);
+
+    for (int i = 0; i < writers * PIDS_PER_WRITER; i++) {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+
+    report("readers", r, readers, seconds);
+    report("writers", w, writers, seconds);
+    free(children);
+    free(r);
+    free(w);
+    return 0;
+}
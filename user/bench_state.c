@@ -0,0 +1,177 @@
+/* Compares two ways of polling the scheduler state: a snapshot of every CPU
+ * and task record of the mapped /proc/sched_plugin/state, and a read and
+ * parse of /proc/sched_plugin/stats. Busy children are registered first so
+ * that both have processes to report and the ticks are switching. Each
+ * reader runs for half of the time; the snapshots per second, their average
+ * and worst latency and the processes seen are reported. Run as root with
+ * the modules loaded.
+ *
+ * Usage: bench_state [children] [seconds]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sched_state.h"
+#include "sched_util.h"
+
+#define PROC_FILE "/proc/process_sched_add"
+#define STATS_FILE "/proc/sched_plugin/stats"
+
+struct result {
+    unsigned long ops;
+    unsigned long long total_ns, max_ns;
+    unsigned long seen; /* Processes seen by the last snapshot */
+};
+
+static void account(struct result *r, unsigned long long t0)
+{
+    unsigned long long d = now_ns() - t0;
+    r->ops++;
+    r->total_ns += d;
+    if (d > r->max_ns)
+        r->max_ns = d;
+}
+
+/* one snapshot of the mapped area, the processes it holds */
+static unsigned long snapshot_mmap(const struct sched_state *st)
+{
+    struct sched_state_task task;
+    struct sched_state_cpu cpu;
+    unsigned long seen = 0;
+
+    for (unsigned int i = 0; i < st->hdr->nr_cpus; i++)
+        sched_state_cpu(st, i, &cpu);
+    for (unsigned int i = 0; i < st->hdr->nr_slots; i++)
+        seen += sched_state_task(st, i, &task);
+    return seen;
+}
+
+/* one read of the stats file, the processes it lists */
+static long snapshot_proc(char *buf, size_t size)
+{
+    unsigned long long run_us, wait_us;
+    unsigned long scheduled, involuntary;
+    int pid, tgid, state, cpu;
+    size_t len = 0;
+    ssize_t n;
+    long seen = 0;
+    char *line;
+    int fd;
+
+    fd = open(STATS_FILE, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    while (len < size - 1 && (n = read(fd, buf + len, size - 1 - len)) > 0)
+        len += n;
+    close(fd);
+    buf[len] = '\0';
+
+    /* The process lines end at the first empty line */
+    line = strchr(buf, '\n');
+    while (line && line[1] != '\n' && line[1] != '\0') {
+        line++;
+        if (sscanf(line, "%d %d %d %d %llu %llu %lu %lu", &pid, &tgid,
+                   &state, &cpu, &run_us, &wait_us, &scheduled,
+                   &involuntary) == 8)
+            seen++;
+        line = strchr(line, '\n');
+    }
+    return seen;
+}
+
+static void report(const char *name, const struct result *r, double seconds)
+{
+    printf("%-6s snapshots/s=%-10.0f avg=%.2fus max=%.2fus processes=%lu\n",
+           name, r->ops / seconds,
+           r->ops ? r->total_ns / 1000.0 / r->ops : 0.0, r->max_ns / 1000.0,
+           r->seen);
+}
+
+int main(int argc, char *argv[])
+{
+    int nr_children = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    struct result mapped = {0}, proc = {0};
+    unsigned long long end;
+    struct sched_state st;
+    size_t buf_size = 1 << 20;
+    pid_t *children;
+    char *buf, pid[16];
+    int fd, len, ret, forked = 0;
+    long seen;
+
+    if (nr_children < 0 || seconds <= 0) {
+        fprintf(stderr, "usage: %s [children] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    ret = sched_state_open(&st);
+    if (ret) {
+        fprintf(stderr, "%s: %s\n", SCHED_STATE_FILE, strerror(-ret));
+        return 1;
+    }
+
+    /* Busy children registered one write each */
+    children = calloc(nr_children + 1, sizeof(*children));
+    buf = malloc(buf_size);
+    for (int i = 0; i < nr_children; i++) {
+        children[i] = fork();
+        if (children[i] < 0) {
+            perror("fork");
+            break;
+        }
+        if (children[i] == 0) {
+            for (;;)
+                ;
+        }
+        forked++;
+        fd = open(PROC_FILE, O_WRONLY);
+        if (fd < 0) {
+            perror(PROC_FILE);
+            break;
+        }
+        len = snprintf(pid, sizeof(pid), "%d", children[i]);
+        if (write(fd, pid, len) < 0)
+            perror("write");
+        close(fd);
+    }
+
+    end = now_ns() + seconds * 500000000ULL;
+    while (now_ns() < end) {
+        unsigned long long t0 = now_ns();
+        mapped.seen = snapshot_mmap(&st);
+        account(&mapped, t0);
+    }
+
+    end = now_ns() + seconds * 500000000ULL;
+    while (now_ns() < end) {
+        unsigned long long t0 = now_ns();
+        seen = snapshot_proc(buf, buf_size);
+        if (seen < 0) {
+            fprintf(stderr, "%s: %s\n", STATS_FILE, strerror(-seen));
+            break;
+        }
+        proc.seen = seen;
+        account(&proc, t0);
+    }
+
+    for (int i = 0; i < forked; i++) {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+
+    report("mmap", &mapped, seconds / 2.0);
+    report("proc", &proc, seconds / 2.0);
+    sched_state_close(&st);
+    free(children);
+    free(buf);
+    return 0;
+}
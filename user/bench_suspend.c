@@ -0,0 +1,199 @@
+/* Compares the suspension backends of proc_queue with the primitives they are
+ * built on: SIGSTOP/SIGCONT for "signal" against switching the task between
+ * SCHED_IDLE and SCHED_OTHER at nice 0 for "idle". A child pinned to the CPU
+ * of the benchmark keeps publishing timestamps. Each round the child is
+ * suspended, the CPU is kept busy for a while and the child is resumed; the
+ * cost of both calls and the delay until the child runs again are reported.
+ * Leaving SCHED_IDLE may require root.
+ *
+ * Usage: bench_suspend [rounds]
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sched_util.h"
+
+#define BUSY_NS 1000000ULL     /* CPU kept busy while the child is suspended */
+#define TIMEOUT_NS 1000000000ULL /* Give up waiting for the child after this */
+
+/* Layout of the sched_setattr(2) argument, not exported by every libc */
+struct bench_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+struct backend {
+    const char *name;
+    int (*suspend)(pid_t pid);
+    int (*resume)(pid_t pid);
+};
+
+struct result {
+    unsigned long rounds, timeouts;
+    unsigned long long suspend_ns, resume_ns, wake_ns, wake_max_ns;
+};
+
+static volatile unsigned long long *seen;
+
+static int set_policy(pid_t pid, int policy, int nice)
+{
+    struct bench_sched_attr attr = {
+        .size = sizeof(attr),
+        .sched_policy = policy,
+        .sched_nice = nice,
+    };
+    return syscall(SYS_sched_setattr, pid, &attr, 0);
+}
+
+static int signal_suspend(pid_t pid)
+{
+    int status;
+
+    if (kill(pid, SIGSTOP) < 0)
+        return -1;
+    /* The stop is asynchronous, wait until it took effect */
+    return waitpid(pid, &status, WUNTRACED) < 0 ? -1 : 0;
+}
+
+static int signal_resume(pid_t pid)
+{
+    return kill(pid, SIGCONT);
+}
+
+static int idle_suspend(pid_t pid)
+{
+    return set_policy(pid, SCHED_IDLE, 0);
+}
+
+static int idle_resume(pid_t pid)
+{
+    return set_policy(pid, SCHED_OTHER, 0);
+}
+
+static const struct backend backends[] = {
+    {"signal", signal_suspend, signal_resume},
+    {"idle", idle_suspend, idle_resume},
+};
+
+static void busy_wait(unsigned long long ns)
+{
+    unsigned long long end = now_ns() + ns;
+
+    while (now_ns() < end)
+        ;
+}
+
+static int run_backend(const struct backend *b, pid_t child, int rounds,
+                       struct result *r)
+{
+    for (int i = 0; i < rounds; i++) {
+        unsigned long long t0, t1, d;
+
+        t0 = now_ns();
+        if (b->suspend(child) < 0)
+            return -1;
+        r->suspend_ns += now_ns() - t0;
+
+        /* Keep the CPU busy so that only a suspended child stays off it */
+        busy_wait(BUSY_NS);
+
+        t0 = now_ns();
+        if (b->resume(child) < 0)
+            return -1;
+        t1 = now_ns();
+        r->resume_ns += t1 - t0;
+
+        /* Wait for the child to publish a timestamp taken after the resume */
+        while (*seen < t0 && now_ns() - t0 < TIMEOUT_NS)
+            ;
+        if (*seen < t0) {
+            r->timeouts++;
+            continue;
+        }
+        d = *seen - t0;
+        r->wake_ns += d;
+        if (d > r->wake_max_ns)
+            r->wake_max_ns = d;
+        r->rounds++;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 1000;
+    cpu_set_t set;
+    pid_t child;
+
+    if (rounds <= 0) {
+        fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    seen = mmap(NULL, sizeof(*seen), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (seen == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    /* The child competes with the benchmark for a single CPU */
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return 1;
+    }
+
+    child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        for (;;)
+            *seen = now_ns();
+    }
+
+    printf("%-8s %-12s %-12s %-12s %-12s\n", "backend", "suspend(us)",
+           "resume(us)", "wake avg(us)", "wake max(us)");
+    for (int i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        struct result r = {0};
+
+        if (run_backend(&backends[i], child, rounds, &r) < 0) {
+            perror(backends[i].name);
+            break;
+        }
+        set_policy(child, SCHED_OTHER, 0);
+        if (!r.rounds) {
+            printf("%-8s no wake-up observed\n", backends[i].name);
+            continue;
+        }
+        printf("%-8s %-12.2f %-12.2f %-12.2f %-12.2f", backends[i].name,
+               r.suspend_ns / 1000.0 / rounds, r.resume_ns / 1000.0 / rounds,
+               r.wake_ns / 1000.0 / r.rounds, r.wake_max_ns / 1000.0);
+        if (r.timeouts)
+            printf(" (%lu timeouts)", r.timeouts);
+        putchar('\n');
+    }
+
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,133 @@
+/* Reader library of /proc/sched_plugin/state, see sched_state.h and
+ * module/sched_plugin_state.h for the layout and the sequence counts.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sched_state.h"
+
+/* Copy a record guarded by the sequence count at seqp. The kernel changes a
+ * record under a spinlock, so an odd count only lasts a few instructions.
+ */
+static void read_record(const __u32 *seqp, void *out, const void *rec,
+                        size_t size)
+{
+    __u32 seq;
+
+    for (;;) {
+        seq = __atomic_load_n(seqp, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        memcpy(out, rec, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(seqp, __ATOMIC_RELAXED) == seq)
+            return;
+    }
+}
+
+int sched_state_open(struct sched_state *st)
+{
+    struct sched_state_header hdr;
+    void *base;
+    int fd, ret;
+
+    fd = open(SCHED_STATE_FILE, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    /* The header tells the size of the whole area */
+    base = mmap(NULL, sizeof(hdr), PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ret = -errno;
+        close(fd);
+        return ret;
+    }
+    memcpy(&hdr, base, sizeof(hdr));
+    munmap(base, sizeof(hdr));
+    if (hdr.magic != SCHED_STATE_MAGIC || hdr.version != SCHED_STATE_VERSION) {
+        close(fd);
+        return -EPROTO;
+    }
+
+    base = mmap(NULL, hdr.size, PROT_READ, MAP_SHARED, fd, 0);
+    ret = base == MAP_FAILED ? -errno : 0;
+    close(fd);
+    if (ret)
+        return ret;
+    st->base = base;
+    st->size = hdr.size;
+    st->hdr = base;
+    return 0;
+}
+
+void sched_state_close(struct sched_state *st)
+{
+    munmap((void *) st->base, st->size);
+    st->base = NULL;
+    st->hdr = NULL;
+}
+
+void sched_state_counts(const struct sched_state *st,
+                        struct sched_state_counts *out)
+{
+    const struct sched_state_header *hdr = st->hdr;
+    __u32 seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        out->nr_tasks = hdr->nr_tasks;
+        out->nr_unslotted = hdr->nr_unslotted;
+        out->generation = hdr->generation;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq)
+            return;
+    }
+}
+
+int sched_state_cpu(const struct sched_state *st,
+                    int cpu,
+                    struct sched_state_cpu *out)
+{
+    const struct sched_state_cpu *rec;
+
+    if (cpu < 0 || (unsigned int) cpu >= st->hdr->nr_cpus)
+        return -1;
+    rec = (const void *) (st->base + st->hdr->cpu_offset +
+                          (size_t) cpu * st->hdr->cpu_size);
+    read_record(&rec->seq, out, rec, sizeof(*out));
+    return 0;
+}
+
+int sched_state_task(const struct sched_state *st,
+                     unsigned int slot,
+                     struct sched_state_task *out)
+{
+    const struct sched_state_task *rec;
+
+    if (slot >= st->hdr->nr_slots)
+        return 0;
+    rec = (const void *) (st->base + st->hdr->task_offset +
+                          (size_t) slot * st->hdr->task_size);
+    /* A free slot is skipped without copying it */
+    if (!__atomic_load_n(&rec->pid, __ATOMIC_RELAXED))
+        return 0;
+    read_record(&rec->seq, out, rec, sizeof(*out));
+    return out->pid != 0;
+}
+
+int sched_state_find(const struct sched_state *st,
+                     pid_t pid,
+                     struct sched_state_task *out)
+{
+    for (unsigned int i = 0; i < st->hdr->nr_slots; i++) {
+        if (sched_state_task(st, i, out) && out->pid == pid)
+            return 1;
+    }
+    return 0;
+}
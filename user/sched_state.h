@@ -0,0 +1,52 @@
+/* Reader of /proc/sched_plugin/state, the scheduler state proc_queue keeps
+ * in a read-only shared area. Once mapped, every call is a plain memory
+ * read retried on a concurrent change: no system call and no lock, so
+ * polling it does not disturb the scheduler.
+ */
+
+#ifndef SCHED_STATE_H
+#define SCHED_STATE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "../module/sched_plugin_state.h"
+
+#define SCHED_STATE_FILE "/proc/sched_plugin/state"
+
+struct sched_state {
+    const char *base; /* Start of the mapping */
+    size_t size;      /* Length of the mapping */
+    const struct sched_state_header *hdr;
+};
+
+/* Counts of the header, read together */
+struct sched_state_counts {
+    unsigned int nr_tasks;
+    unsigned int nr_unslotted;
+    unsigned long long generation;
+};
+
+/* Map the state area, 0 on success or -errno */
+int sched_state_open(struct sched_state *st);
+void sched_state_close(struct sched_state *st);
+
+void sched_state_counts(const struct sched_state *st,
+                        struct sched_state_counts *out);
+
+/* Copy the record of a CPU, 0 on success or -1 for a CPU out of range */
+int sched_state_cpu(const struct sched_state *st,
+                    int cpu,
+                    struct sched_state_cpu *out);
+
+/* Copy a task record, 1 if the slot holds a process and 0 if it is free */
+int sched_state_task(const struct sched_state *st,
+                     unsigned int slot,
+                     struct sched_state_task *out);
+
+/* Look a process up by PID, 1 if found and 0 otherwise */
+int sched_state_find(const struct sched_state *st,
+                     pid_t pid,
+                     struct sched_state_task *out);
+
+#endif /* SCHED_STATE_H */
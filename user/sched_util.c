@@ -0,0 +1,65 @@
+/* Helpers shared by the tests and benchmarks, see sched_util.h */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sched_util.h"
+
+int write_file(const char *path, const char *val)
+{
+    FILE *fp = fopen(path, "w");
+    int ret;
+
+    if (!fp) {
+        ret = -errno;
+        perror(path);
+        return ret;
+    }
+    ret = fprintf(fp, "%s", val) < 0 ? -errno : 0;
+    if (fclose(fp) != 0 && !ret)
+        ret = -errno;
+    if (ret)
+        fprintf(stderr, "%s: cannot write \"%s\": %s\n", path, val,
+                strerror(-ret));
+    return ret;
+}
+
+int read_tunable(const char *path, char *val, size_t size)
+{
+    FILE *fp = fopen(path, "r");
+    char line[256], *start, *end;
+
+    if (!fp || !fgets(line, sizeof(line), fp)) {
+        perror(path);
+        if (fp)
+            fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    start = strchr(line, '[');
+    if (start) {
+        end = strchr(++start, ']');
+    } else {
+        start = line;
+        end = strchr(line, '\n');
+    }
+    if (end)
+        *end = '\0';
+    snprintf(val, size, "%s", start);
+    return 0;
+}
+
+unsigned long long clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned long long now_ns(void)
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
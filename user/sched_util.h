@@ -0,0 +1,26 @@
+/* Helpers shared by the tests and benchmarks: tunables of
+ * /proc/sched_plugin and clock readings in nanoseconds.
+ */
+
+#ifndef SCHED_UTIL_H
+#define SCHED_UTIL_H
+
+#include <stddef.h>
+#include <time.h>
+
+/* Write a value into a /proc file, 0 on success or -errno after printing
+ * the error
+ */
+int write_file(const char *path, const char *val);
+
+/* Current value of a tunable, the bracketed entry of a list if there is one,
+ * 0 on success or -1
+ */
+int read_tunable(const char *path, char *val, size_t size);
+
+unsigned long long clock_ns(clockid_t clk);
+
+/* CLOCK_MONOTONIC in nanoseconds */
+unsigned long long now_ns(void);
+
+#endif /* SCHED_UTIL_H */
@@ -0,0 +1,223 @@
+/* Checks the deadline policy: periodic children are registered with a
+ * reservation of their runtime every period. Each job of a child starts at
+ * the beginning of its period, burns its runtime of CPU time and is checked
+ * against its deadline, the end of the period. The children count their jobs
+ * and missed deadlines in shared memory and the miss ratio of each of them is
+ * reported, next to the jobs and misses the kernel counted for it in
+ * /proc/sched_plugin/stats. Both ratios must stay below MAX_MISS_RATIO. A
+ * child refused by the admission control is reported as such.
+ * Load proc_queue with a single CPU, e.g. "cpus=0", and proc_edf before
+ * running this as root.
+ *
+ * Usage: test_edf [seconds] [runtime_us:period_us...]
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sched_util.h"
+
+#define PROC_FILE "/proc/process_sched_add"
+#define POLICY_FILE "/proc/sched_plugin/policy"
+#define QUANTUM_FILE "/proc/sched_plugin/quantum"
+#define STATS_FILE "/proc/sched_plugin/stats"
+#define QUANTUM_US "1000"
+#define MAX_CHILDREN 16
+#define MAX_MISS_RATIO 0.01 /* Accepted share of missed deadlines */
+
+struct task {
+    unsigned long runtime_us, period_us;
+    pid_t pid;
+    int admitted, alive;
+    unsigned long kjobs, kmissed; /* Counted by the kernel */
+};
+
+/* Job counters of a child, written by the child only */
+struct counters {
+    volatile unsigned long jobs, missed;
+};
+
+static void sleep_until(unsigned long long ns)
+{
+    struct timespec ts = {
+        .tv_sec = ns / 1000000000ULL,
+        .tv_nsec = ns % 1000000000ULL,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR)
+        ;
+}
+
+/* Jobs and missed deadlines the kernel counted for each child */
+static void read_kernel_stats(struct task *tasks, int n)
+{
+    FILE *fp = fopen(STATS_FILE, "r");
+    unsigned long jobs, missed;
+    char line[256];
+    int pid;
+
+    if (!fp) {
+        perror(STATS_FILE);
+        return;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%d %*d %*d %*d %*u %*u %*u %*u %lu %lu", &pid,
+                   &jobs, &missed) != 3)
+            continue;
+        for (int i = 0; i < n; i++) {
+            if (tasks[i].pid == pid) {
+                tasks[i].kjobs = jobs;
+                tasks[i].kmissed = missed;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+static double ratio(unsigned long missed, unsigned long jobs)
+{
+    return jobs ? (double) missed / jobs : 0.0;
+}
+
+/* Body of a periodic child: one job of runtime CPU time per period */
+static void periodic(const struct task *t, struct counters *c)
+{
+    unsigned long long runtime = t->runtime_us * 1000ULL;
+    unsigned long long period = t->period_us * 1000ULL;
+    unsigned long long release = clock_ns(CLOCK_MONOTONIC);
+
+    for (;;) {
+        unsigned long long end;
+
+        /* Wait for the next period, a late job starts right away */
+        sleep_until(release);
+        end = clock_ns(CLOCK_THREAD_CPUTIME_ID) + runtime;
+        while (clock_ns(CLOCK_THREAD_CPUTIME_ID) < end)
+            ;
+        c->jobs++;
+        if (clock_ns(CLOCK_MONOTONIC) > release + period)
+            c->missed++;
+        release += period;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct task tasks[MAX_CHILDREN] = {
+        {.runtime_us = 2000, .period_us = 10000},
+        {.runtime_us = 3000, .period_us = 20000},
+        {.runtime_us = 5000, .period_us = 50000},
+    };
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    char old_policy[64], old_quantum[64], buf[128];
+    unsigned long jobs = 0, missed = 0, kjobs = 0, kmissed = 0;
+    struct counters *counters;
+    int n = 3, failed = 0;
+
+    if (argc > 2) {
+        n = argc - 2 < MAX_CHILDREN ? argc - 2 : MAX_CHILDREN;
+        for (int i = 0; i < n; i++) {
+            if (sscanf(argv[i + 2], "%lu:%lu", &tasks[i].runtime_us,
+                       &tasks[i].period_us) != 2 ||
+                !tasks[i].runtime_us ||
+                tasks[i].runtime_us > tasks[i].period_us)
+                seconds = 0;
+        }
+    }
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [seconds] [runtime_us:period_us...]\n",
+                argv[0]);
+        return 1;
+    }
+
+    counters = mmap(NULL, sizeof(*counters) * n, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (counters == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (read_tunable(POLICY_FILE, old_policy, sizeof(old_policy)) ||
+        read_tunable(QUANTUM_FILE, old_quantum, sizeof(old_quantum)) ||
+        write_file(POLICY_FILE, "edf") || write_file(QUANTUM_FILE, QUANTUM_US))
+        return 1;
+
+    for (int i = 0; i < n; i++) {
+        int ret;
+
+        tasks[i].pid = fork();
+        if (tasks[i].pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (tasks[i].pid == 0)
+            periodic(&tasks[i], &counters[i]);
+        tasks[i].alive = 1;
+
+        snprintf(buf, sizeof(buf), "%d,runtime=%lu,period=%lu", tasks[i].pid,
+                 tasks[i].runtime_us, tasks[i].period_us);
+        ret = write_file(PROC_FILE, buf);
+        tasks[i].admitted = !ret;
+        if (ret == -EBUSY) {
+            /* Refused by the admission control, leave it out */
+            kill(tasks[i].pid, SIGKILL);
+            waitpid(tasks[i].pid, NULL, 0);
+            tasks[i].alive = 0;
+        } else if (ret) {
+            failed = 1;
+        }
+    }
+
+    if (!failed) {
+        sleep(seconds);
+        read_kernel_stats(tasks, n);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!tasks[i].alive)
+            continue;
+        kill(tasks[i].pid, SIGKILL);
+        waitpid(tasks[i].pid, NULL, 0);
+    }
+    write_file(POLICY_FILE, old_policy);
+    write_file(QUANTUM_FILE, old_quantum);
+    if (failed)
+        return 1;
+
+    printf("%-8s %-12s %-12s %-8s %-8s %-8s %-8s %-8s %-8s\n", "pid",
+           "runtime(us)", "period(us)", "jobs", "missed", "ratio", "k_jobs",
+           "k_missed", "k_ratio");
+    for (int i = 0; i < n; i++) {
+        const struct task *t = &tasks[i];
+
+        if (!t->admitted) {
+            printf("%-8d %-12lu %-12lu rejected by admission control\n",
+                   t->pid, t->runtime_us, t->period_us);
+            continue;
+        }
+        printf("%-8d %-12lu %-12lu %-8lu %-8lu %-8.4f %-8lu %-8lu %-8.4f\n",
+               t->pid, t->runtime_us, t->period_us, counters[i].jobs,
+               counters[i].missed, ratio(counters[i].missed, counters[i].jobs),
+               t->kjobs, t->kmissed, ratio(t->kmissed, t->kjobs));
+        jobs += counters[i].jobs;
+        missed += counters[i].missed;
+        kjobs += t->kjobs;
+        kmissed += t->kmissed;
+    }
+    if (!jobs || !kjobs)
+        return 1;
+    printf("miss ratio %.4f, kernel %.4f\n", ratio(missed, jobs),
+           ratio(kmissed, kjobs));
+    failed = ratio(missed, jobs) > MAX_MISS_RATIO ||
+             ratio(kmissed, kjobs) > MAX_MISS_RATIO;
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed;
+}
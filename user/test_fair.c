@@ -0,0 +1,120 @@
+/* Checks the fair share policy: busy children are registered with different
+ * weights and the CPU time each of them gets is compared with its share of
+ * the total weight. The shares only show when the children compete for one
+ * run queue, so load proc_queue with a single CPU, e.g. "cpus=0", and
+ * proc_fair before running this as root.
+ *
+ * Usage: test_fair [seconds] [weight...]
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sched_util.h"
+
+#define PROC_FILE "/proc/process_sched_add"
+#define POLICY_FILE "/proc/sched_plugin/policy"
+#define QUANTUM_FILE "/proc/sched_plugin/quantum"
+#define QUANTUM_US "10000"
+#define MAX_CHILDREN 16
+#define TOLERANCE 0.05 /* Accepted deviation of a share, absolute */
+
+/* user plus system time of a process in clock ticks */
+static unsigned long cpu_ticks(pid_t pid)
+{
+    unsigned long utime, stime;
+    char path[64], buf[1024], *p;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    fp = fopen(path, "r");
+    if (!fp || !fgets(buf, sizeof(buf), fp)) {
+        if (fp)
+            fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    /* Fields 14 and 15, counted after the command name in parentheses */
+    p = strrchr(buf, ')');
+    if (!p || sscanf(p + 2,
+                     "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                     &utime, &stime) != 2)
+        return 0;
+    return utime + stime;
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    int weights[MAX_CHILDREN] = {1024, 2048, 4096};
+    unsigned long ticks[MAX_CHILDREN], total_ticks = 0;
+    char old_policy[64], old_quantum[64], buf[64];
+    pid_t children[MAX_CHILDREN];
+    int n = 3, total_weight = 0, failed = 0;
+
+    if (argc > 2) {
+        n = argc - 2 < MAX_CHILDREN ? argc - 2 : MAX_CHILDREN;
+        for (int i = 0; i < n; i++)
+            weights[i] = atoi(argv[i + 2]);
+    }
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [seconds] [weight...]\n", argv[0]);
+        return 1;
+    }
+
+    if (read_tunable(POLICY_FILE, old_policy, sizeof(old_policy)) ||
+        read_tunable(QUANTUM_FILE, old_quantum, sizeof(old_quantum)) ||
+        write_file(POLICY_FILE, "fair") || write_file(QUANTUM_FILE, QUANTUM_US))
+        return 1;
+
+    for (int i = 0; i < n; i++) {
+        children[i] = fork();
+        if (children[i] < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (children[i] == 0) {
+            for (;;)
+                ;
+        }
+        snprintf(buf, sizeof(buf), "%d,weight=%d", children[i], weights[i]);
+        if (write_file(PROC_FILE, buf))
+            failed = 1;
+        total_weight += weights[i];
+    }
+
+    if (!failed)
+        sleep(seconds);
+
+    for (int i = 0; i < n; i++) {
+        ticks[i] = cpu_ticks(children[i]);
+        total_ticks += ticks[i];
+    }
+    for (int i = 0; i < n; i++) {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+    write_file(POLICY_FILE, old_policy);
+    write_file(QUANTUM_FILE, old_quantum);
+    if (failed || !total_ticks)
+        return 1;
+
+    printf("%-8s %-8s %-10s %-10s\n", "pid", "weight", "expected", "achieved");
+    for (int i = 0; i < n; i++) {
+        double expected = (double) weights[i] / total_weight;
+        double achieved = (double) ticks[i] / total_ticks;
+        int off = achieved - expected > TOLERANCE ||
+                  expected - achieved > TOLERANCE;
+
+        printf("%-8d %-8d %-10.3f %-10.3f%s\n", children[i], weights[i],
+               expected, achieved, off ? "  <- off" : "");
+        failed |= off;
+    }
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed;
+}
@@ -0,0 +1,151 @@
+/* Checks that the threads of a process registered together with "tgid:PID"
+ * are spread over separate run queues, as gang scheduling needs them to be.
+ * A child starts one thread less than there are plugin CPUs and registers
+ * all of its threads with a single write; the CPUs of their task records in
+ * /proc/sched_plugin/state must then all differ. Run as root with the
+ * modules loaded on at least two CPUs.
+ *
+ * Usage: test_gang
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sched_state.h"
+
+#define PROC_FILE "/proc/process_sched_add"
+#define MAX_THREADS 16
+#define TIMEOUT_MS 5000
+
+static pthread_barrier_t started;
+
+static void *sleeper(void *arg)
+{
+    pthread_barrier_wait(&started);
+    for (;;)
+        sleep(1);
+    return NULL;
+}
+
+/* Body of the child: start the threads and register the whole process */
+static void child(int nr_threads)
+{
+    pthread_t threads[MAX_THREADS];
+    FILE *fp;
+
+    pthread_barrier_init(&started, NULL, nr_threads + 1);
+    for (int i = 0; i < nr_threads; i++) {
+        if (pthread_create(&threads[i], NULL, sleeper, NULL)) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&started);
+
+    fp = fopen(PROC_FILE, "w");
+    if (!fp) {
+        perror(PROC_FILE);
+        exit(1);
+    }
+    fprintf(fp, "tgid:%d", getpid());
+    fclose(fp);
+    for (;;)
+        pause();
+}
+
+/* CPUs owning a run queue */
+static int active_cpus(const struct sched_state *st)
+{
+    struct sched_state_cpu cpu;
+    int nr = 0;
+
+    for (unsigned int i = 0; i < st->hdr->nr_cpus; i++) {
+        if (!sched_state_cpu(st, i, &cpu) && cpu.active)
+            nr++;
+    }
+    return nr;
+}
+
+/* Registered threads of a thread group, their CPUs counted in cpus */
+static int gang_members(const struct sched_state *st,
+                        pid_t tgid,
+                        unsigned int *cpus)
+{
+    struct sched_state_task task;
+    int nr = 0;
+
+    memset(cpus, 0, sizeof(*cpus) * st->hdr->nr_cpus);
+    for (unsigned int i = 0; i < st->hdr->nr_slots; i++) {
+        if (!sched_state_task(st, i, &task) || task.tgid != tgid)
+            continue;
+        if (task.cpu >= 0 && (unsigned int) task.cpu < st->hdr->nr_cpus)
+            cpus[task.cpu]++;
+        nr++;
+    }
+    return nr;
+}
+
+int main(void)
+{
+    struct timespec tick = {0, 10 * 1000 * 1000};
+    struct sched_state st;
+    int nr_cpus, nr, shared = 0, failed, ret;
+    unsigned int *cpus;
+    pid_t pid;
+
+    ret = sched_state_open(&st);
+    if (ret) {
+        fprintf(stderr, "%s: %s\n", SCHED_STATE_FILE, strerror(-ret));
+        return 1;
+    }
+    nr_cpus = active_cpus(&st);
+    if (nr_cpus < 2) {
+        printf("SKIP: the plugin runs on a single CPU\n");
+        sched_state_close(&st);
+        return 0;
+    }
+    if (nr_cpus > MAX_THREADS + 1)
+        nr_cpus = MAX_THREADS + 1;
+    cpus = calloc(st.hdr->nr_cpus, sizeof(*cpus));
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0)
+        child(nr_cpus - 1);
+
+    /* Wait for every thread of the child to show up */
+    for (int ms = 0; ms < TIMEOUT_MS; ms += 10) {
+        nr = gang_members(&st, pid, cpus);
+        if (nr == nr_cpus)
+            break;
+        nanosleep(&tick, NULL);
+    }
+
+    printf("%-6s %s\n", "cpu", "threads");
+    for (unsigned int i = 0; i < st.hdr->nr_cpus; i++) {
+        if (!cpus[i])
+            continue;
+        printf("%-6u %u\n", i, cpus[i]);
+        if (cpus[i] > 1)
+            shared += cpus[i] - 1;
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+
+    failed = nr != nr_cpus || shared;
+    printf("%d of %d threads registered, %d sharing a CPU\n", nr, nr_cpus,
+           shared);
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    free(cpus);
+    sched_state_close(&st);
+    return failed;
+}
@@ -0,0 +1,181 @@
+/* Checks the notification file: busy children run short critical sections
+ * of CPU time and count the ones they were switched out in the middle of,
+ * seen as a section taking far longer than its CPU time. Without cooperation
+ * the children are stopped wherever their quantum ends. With it, each child
+ * opens /proc/sched_plugin/notify, asks to be warned ahead of the end of its
+ * quantum and yields through the file at the next safe point, between two
+ * sections; hardly any section should be cut any more. Load proc_queue with
+ * a single CPU, e.g. "cpus=0", before running this as root.
+ *
+ * Usage: test_notify [seconds]
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sched_util.h"
+
+#define PROC_FILE "/proc/process_sched_add"
+#define NOTIFY_FILE "/proc/sched_plugin/notify"
+#define POLICY_FILE "/proc/sched_plugin/policy"
+#define QUANTUM_FILE "/proc/sched_plugin/quantum"
+#define QUANTUM_US "50000"
+#define LEAD "lead=10000"
+#define SECTION_NS 1000000ULL /* CPU time of a critical section */
+#define CUT_NS 5000000ULL     /* Wall time of a section cut by a switch */
+#define NR_CHILDREN 2
+#define MAX_CUT_RATIO 0.002 /* Accepted share of cut sections, cooperating */
+
+/* Counters of a child, written by the child only */
+struct counters {
+    volatile unsigned long sections, cut, yields;
+};
+
+/* whether the events read from the notification file hold the given one */
+static int read_event(int fd, const char *event)
+{
+    char buf[256];
+    ssize_t len;
+    int found = 0;
+
+    while ((len = read(fd, buf, sizeof(buf) - 1)) > 0) {
+        buf[len] = '\0';
+        for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n"))
+            found |= !strcmp(line, event);
+    }
+    return found;
+}
+
+/* Yield and wait to be switched out, the child is stopped meanwhile. A
+ * child alone on its CPU is picked again and hears nothing.
+ */
+static void yield(int fd)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+    if (write(fd, "yield", 5) < 0)
+        return;
+    while (poll(&pfd, 1, 100) > 0) {
+        if (read_event(fd, "out"))
+            break;
+    }
+}
+
+/* Body of a child: critical sections back to back, yielding between two of
+ * them once warned if cooperating
+ */
+static void worker(int cooperate, struct counters *c)
+{
+    char pid[16];
+    int fd = -1;
+
+    if (cooperate) {
+        fd = open(NOTIFY_FILE, O_RDWR | O_NONBLOCK);
+        if (fd < 0 || write(fd, LEAD, strlen(LEAD)) < 0) {
+            perror(NOTIFY_FILE);
+            exit(1);
+        }
+    }
+    snprintf(pid, sizeof(pid), "%d", getpid());
+    if (write_file(PROC_FILE, pid))
+        exit(1);
+
+    for (;;) {
+        unsigned long long start, end;
+
+        if (fd >= 0 && read_event(fd, "out_soon")) {
+            c->yields++;
+            yield(fd);
+        }
+
+        start = clock_ns(CLOCK_MONOTONIC);
+        end = clock_ns(CLOCK_THREAD_CPUTIME_ID) + SECTION_NS;
+        while (clock_ns(CLOCK_THREAD_CPUTIME_ID) < end)
+            ;
+        c->sections++;
+        if (clock_ns(CLOCK_MONOTONIC) - start > CUT_NS)
+            c->cut++;
+    }
+}
+
+/* run the children for a while, the ratio of cut sections or -1 */
+static double run(int cooperate, int seconds, struct counters *c)
+{
+    unsigned long sections = 0, cut = 0;
+    pid_t pids[NR_CHILDREN];
+
+    memset((void *) c, 0, sizeof(*c) * NR_CHILDREN);
+    for (int i = 0; i < NR_CHILDREN; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            perror("fork");
+            return -1;
+        }
+        if (pids[i] == 0)
+            worker(cooperate, &c[i]);
+    }
+    sleep(seconds);
+    for (int i = 0; i < NR_CHILDREN; i++) {
+        kill(pids[i], SIGKILL);
+        waitpid(pids[i], NULL, 0);
+    }
+
+    printf("%s:\n", cooperate ? "cooperating" : "not cooperating");
+    printf("  %-8s %-10s %-8s %-8s\n", "child", "sections", "cut", "yields");
+    for (int i = 0; i < NR_CHILDREN; i++) {
+        printf("  %-8d %-10lu %-8lu %-8lu\n", i, c[i].sections, c[i].cut,
+               c[i].yields);
+        sections += c[i].sections;
+        cut += c[i].cut;
+    }
+    if (!sections)
+        return -1;
+    printf("  cut ratio %.4f\n", (double) cut / sections);
+    return (double) cut / sections;
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    char old_policy[64], old_quantum[64];
+    struct counters *c;
+    double plain, coop;
+    int failed;
+
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    c = mmap(NULL, sizeof(*c) * NR_CHILDREN, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (c == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (read_tunable(POLICY_FILE, old_policy, sizeof(old_policy)) ||
+        read_tunable(QUANTUM_FILE, old_quantum, sizeof(old_quantum)) ||
+        write_file(POLICY_FILE, "rr") || write_file(QUANTUM_FILE, QUANTUM_US))
+        return 1;
+
+    plain = run(0, seconds, c);
+    coop = run(1, seconds, c);
+
+    write_file(POLICY_FILE, old_policy);
+    write_file(QUANTUM_FILE, old_quantum);
+    if (plain < 0 || coop < 0)
+        return 1;
+
+    failed = coop > MAX_CUT_RATIO;
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed;
+}
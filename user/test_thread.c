@@ -6,6 +6,8 @@
 
 #define N_THREADS 2
 
+static pthread_barrier_t started;
+
 void *test_pthread(void *ptr)
 {
 #ifdef SYS_gettid
@@ -13,9 +15,7 @@ void *test_pthread(void *ptr)
 #else
 #error "SYS_gettid unavailable on this system"
 #endif
-    FILE *fp = fopen("/proc/process_sched_add", "w");
-    fprintf(fp, "%d", tid);
-    fclose(fp);
+    pthread_barrier_wait(&started);
 
     while (1) {
         printf("TID: %d\n", tid);
@@ -27,6 +27,9 @@ void *test_pthread(void *ptr)
 int main()
 {
     pthread_t threads[N_THREADS];
+    FILE *fp;
+
+    pthread_barrier_init(&started, NULL, N_THREADS + 1);
     for (long t = 0; t < N_THREADS; t++) {
         printf("In main: creating thread %ld\n", t);
         int rc = pthread_create(&threads[t], NULL, test_pthread, NULL);
@@ -35,6 +38,16 @@ int main()
             exit(-1);
         }
     }
+    pthread_barrier_wait(&started);
+
+    /* Register every thread of the process with a single write */
+    fp = fopen("/proc/process_sched_add", "w");
+    if (!fp) {
+        perror("/proc/process_sched_add");
+        exit(-1);
+    }
+    fprintf(fp, "tgid:%d", getpid());
+    fclose(fp);
 
     /* Last thing that main() should do */
     pthread_exit(NULL);
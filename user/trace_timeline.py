@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Turns a trace-cmd capture of the sched_plugin tracepoints into per task
+timelines and a summary of the switch overhead.
+
+Capture and report:
+
+    sudo trace-cmd record -e sched_plugin -- sleep 10
+    ./user/trace_timeline.py trace.dat
+
+A trace.dat is read through "trace-cmd report", any other file is taken as
+the text output of it, "-" as that text on the standard input.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+from collections import defaultdict
+
+EVENT_RE = re.compile(r"\s([\d.]+):\s+(sched_plugin_\w+):\s+(.*)$")
+FIELD_RE = re.compile(r"(\w+)=(\S+)")
+
+
+def read_events(path):
+    """Yield (timestamp in ns, event name, fields) for every event."""
+    if path.endswith(".dat"):
+        out = subprocess.run(["trace-cmd", "report", "-i", path],
+                             check=True, capture_output=True, text=True)
+        lines = out.stdout.splitlines()
+    elif path == "-":
+        lines = sys.stdin
+    else:
+        with open(path) as f:
+            lines = f.readlines()
+
+    for line in lines:
+        m = EVENT_RE.search(line)
+        if not m:
+            continue
+        ts = int(round(float(m.group(1)) * 1e9))
+        yield ts, m.group(2), dict(FIELD_RE.findall(m.group(3)))
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class Task:
+    def __init__(self, pid):
+        self.pid = pid
+        self.intervals = []  # (start, end, cpu) on the CPU
+        self.wait_ns = 0
+        self.picks = 0
+        self.blocks = 0
+
+    @property
+    def run_ns(self):
+        return sum(end - start for start, end, _ in self.intervals)
+
+
+def build(events):
+    tasks = {}
+    running = {}  # CPU -> (pid, since)
+    ticks = defaultdict(list)  # CPU -> [(slip_ns, cost_ns)]
+    first = last = None
+
+    def task(pid):
+        if pid not in tasks:
+            tasks[pid] = Task(pid)
+        return tasks[pid]
+
+    def stop(cpu, ts):
+        if cpu in running:
+            pid, since = running.pop(cpu)
+            task(pid).intervals.append((since, ts, cpu))
+
+    for ts, name, f in events:
+        first = ts if first is None else first
+        last = ts
+        if name == "sched_plugin_enqueue":
+            task(int(f["pid"]))
+        elif name == "sched_plugin_remove":
+            pid = int(f["pid"])
+            for cpu, (running_pid, _) in list(running.items()):
+                if running_pid == pid:
+                    stop(cpu, ts)
+        elif name == "sched_plugin_pick":
+            cpu, pid = int(f["cpu"]), int(f["next_pid"])
+            if cpu in running and running[cpu][0] == pid:
+                continue
+            stop(cpu, ts)
+            t = task(pid)
+            t.picks += 1
+            t.wait_ns += int(f["wait_ns"])
+            running[cpu] = (pid, ts)
+        elif name == "sched_plugin_state":
+            if f.get("new_state") == "blocked":
+                task(int(f["pid"])).blocks += 1
+        elif name == "sched_plugin_tick":
+            cpu = int(f["cpu"])
+            ticks[cpu].append((int(f["slip_ns"]), int(f["cost_ns"])))
+            if int(f["next_pid"]) == -1:
+                stop(cpu, ts)
+
+    for cpu in list(running):
+        stop(cpu, last)
+    return tasks, ticks, first or 0
+
+
+def print_timelines(tasks, first, max_intervals):
+    print("Per task timelines (ms since the first event)")
+    print("%-8s %-10s %-10s %-7s %-7s %s" %
+          ("pid", "run_ms", "wait_ms", "picks", "blocks", "intervals"))
+    for pid in sorted(tasks):
+        t = tasks[pid]
+        spans = ["%.3f-%.3f@%d" % ((s - first) / 1e6, (e - first) / 1e6, c)
+                 for s, e, c in t.intervals[:max_intervals]]
+        if len(t.intervals) > max_intervals:
+            spans.append("... %d more" % (len(t.intervals) - max_intervals))
+        print("%-8d %-10.3f %-10.3f %-7d %-7d %s" %
+              (pid, t.run_ns / 1e6, t.wait_ns / 1e6, t.picks, t.blocks,
+               " ".join(spans)))
+
+
+def print_overhead(ticks):
+    print("\nSwitch overhead (us)")
+    print("%-5s %-8s %-9s %-9s %-9s %-9s %-9s %s" %
+          ("cpu", "ticks", "cost_avg", "cost_p50", "cost_p99", "cost_max",
+           "slip_avg", "slip_p99"))
+    rows = sorted(ticks.items())
+    if len(rows) > 1:
+        rows.append(("all", [v for _, vals in rows for v in vals]))
+    for cpu, vals in rows:
+        slips = [s for s, _ in vals]
+        costs = [c for _, c in vals]
+        print("%-5s %-8d %-9.1f %-9.1f %-9.1f %-9.1f %-9.1f %.1f" %
+              (cpu, len(vals), sum(costs) / len(costs) / 1e3,
+               percentile(costs, 50) / 1e3, percentile(costs, 99) / 1e3,
+               max(costs) / 1e3, sum(slips) / len(slips) / 1e3,
+               percentile(slips, 99) / 1e3))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", help="trace.dat, trace-cmd report text or -")
+    parser.add_argument("-n", "--intervals", type=int, default=8,
+                        help="intervals shown per task (default 8)")
+    args = parser.parse_args()
+
+    tasks, ticks, first = build(read_events(args.trace))
+    if not tasks and not ticks:
+        print("no sched_plugin events found", file=sys.stderr)
+        return 1
+    print_timelines(tasks, first, args.intervals)
+    if ticks:
+        print_overhead(ticks)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())